@@ -0,0 +1,90 @@
+//
+//  affine2.h
+//  CurvesEditor
+//
+//  2D affine transforms (move / rotate / scale) and the kernel that applies
+//  one to a contiguous run of points.
+//
+
+#pragma once
+
+#include <cmath>
+#include "float2.h"
+
+//  | a  b  tx |
+//  | c  d  ty |
+template <class S>
+class affine2
+{
+public:
+    S a, b, c, d;
+    S tx, ty;
+
+    constexpr affine2():a(1),b(0),c(0),d(1),tx(0),ty(0){}
+
+    constexpr affine2(S a, S b, S c, S d, S tx, S ty):a(a),b(b),c(c),d(d),tx(tx),ty(ty){}
+
+    static constexpr affine2 translation(vec2<S> offset)
+    {
+        return affine2(1, 0, 0, 1, offset.x, offset.y);
+    }
+
+    //counterclockwise by angle radians around pivot
+    static affine2 rotation(S angle, vec2<S> pivot)
+    {
+        S cs = std::cos(angle);
+        S sn = std::sin(angle);
+        return affine2(cs, -sn, sn, cs,
+                       pivot.x - cs * pivot.x + sn * pivot.y,
+                       pivot.y - sn * pivot.x - cs * pivot.y);
+    }
+
+    static constexpr affine2 scaling(vec2<S> factor, vec2<S> pivot)
+    {
+        return affine2(factor.x, 0, 0, factor.y,
+                       pivot.x - factor.x * pivot.x,
+                       pivot.y - factor.y * pivot.y);
+    }
+
+    //applies other first, then this
+    constexpr affine2 operator*(const affine2& other) const
+    {
+        return affine2(a * other.a + b * other.c, a * other.b + b * other.d,
+                       c * other.a + d * other.c, c * other.b + d * other.d,
+                       a * other.tx + b * other.ty + tx,
+                       c * other.tx + d * other.ty + ty);
+    }
+
+    constexpr vec2<S> operator()(vec2<S> p) const
+    {
+        return vec2<S>(a * p.x + b * p.y + tx, c * p.x + d * p.y + ty);
+    }
+};
+
+
+//transforms n points in place in a single pass, four at a time: each group
+//of four is split into x and y lanes, transformed with lane-wide
+//multiply-adds, and interleaved back, which the compiler turns into full
+//width SIMD instead of one point per vector
+template <class S>
+void transformPoints(const affine2<S>& m, vec2<S>* points, int n)
+{
+    typedef lanes<S, 4> batch;
+    const batch a(m.a), b(m.b), c(m.c), d(m.d), tx(m.tx), ty(m.ty);
+    int i = 0;
+    for(; i + 4 <= n; i += 4){
+        batch x, y;
+        for(int k=0; k<4; k++){
+            x.v[k] = points[i + k].x;
+            y.v[k] = points[i + k].y;
+        }
+        batch rx = a * x + b * y + tx;
+        batch ry = c * x + d * y + ty;
+        for(int k=0; k<4; k++){
+            points[i + k].x = rx.v[k];
+            points[i + k].y = ry.v[k];
+        }
+    }
+    for(; i < n; i++)
+        points[i] = m(points[i]);
+}
@@ -0,0 +1,71 @@
+//
+//  allocaudit.cpp
+//  CurvesEditor
+//
+
+#include "allocaudit.h"
+
+#include <stdlib.h>
+#include <atomic>
+#include <new>
+
+#ifdef CURVES_ALLOCATION_AUDIT
+
+static std::atomic<unsigned long long> allocations(0);
+
+void* operator new(size_t size){
+    allocations++;
+    void *p = malloc(size == 0 ? 1 : size);
+    if(p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](size_t size){
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept{
+    allocations++;
+    return malloc(size == 0 ? 1 : size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept{
+    return operator new(size, std::nothrow);
+}
+
+void operator delete(void *p) noexcept{
+    free(p);
+}
+
+void operator delete[](void *p) noexcept{
+    free(p);
+}
+
+void operator delete(void *p, const std::nothrow_t&) noexcept{
+    free(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t&) noexcept{
+    free(p);
+}
+
+unsigned long long allocationCount(){
+    return allocations;
+}
+
+bool allocationAuditEnabled(){
+    return true;
+}
+
+#else
+
+unsigned long long allocationCount(){
+    return 0;
+}
+
+bool allocationAuditEnabled(){
+    return false;
+}
+
+#endif
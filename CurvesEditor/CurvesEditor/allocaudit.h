@@ -0,0 +1,23 @@
+//
+//  allocaudit.h
+//  CurvesEditor
+//
+//  Counts heap allocations. The Audit build configuration defines
+//  CURVES_ALLOCATION_AUDIT, which replaces the global operator new/delete
+//  with counting versions:
+//
+//      xcodebuild -configuration Audit
+//      build/Audit/CurvesEditor --audit-allocations
+//
+//  Other configurations leave operator new alone and the count stays 0.
+//
+
+#ifndef __CurvesEditor__allocaudit__
+#define __CurvesEditor__allocaudit__
+
+//operator new calls since the process started, from every thread
+unsigned long long allocationCount();
+
+bool allocationAuditEnabled();
+
+#endif /* defined(__CurvesEditor__allocaudit__) */
@@ -0,0 +1,124 @@
+//
+//  arclength.h
+//  CurvesEditor
+//
+//  Cumulative chord length over a sampled curve, for going from distance
+//  along the curve back to its parameter in O(log n): binary search for the
+//  bracketing samples, then a cubic Hermite correction inside the bracket.
+//  Tables over curves that are straight between samples (polylines)
+//  interpolate linearly instead, which is exact there; Hermite slopes
+//  taken across a corner would bend t inside the neighbouring segments.
+//
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include "float2.h"
+
+template <class S>
+class ArcLengthTable
+{
+    //sample parameters, increasing
+    std::vector<S> params;
+    //distance from the first sample to each sample, lengths[0] == 0
+    std::vector<S> lengths;
+    //t is linear in distance between samples
+    bool linear = false;
+
+    //cumulative lengths; the storage is reused, so a rebuild at the same size does not allocate
+    void measure(const vec2<S>* points, int n, bool linear)
+    {
+        this->linear = linear;
+        lengths.resize(n);
+        S total = 0;
+        for(int i=0; i<n; i++){
+            if(i > 0)
+                total += (points[i] - points[i-1]).norm();
+            lengths[i] = total;
+        }
+    }
+
+    //dt/ds at sample i from its neighbours, one-sided at the ends
+    S slopeAt(int i) const
+    {
+        int lo = i > 0 ? i - 1 : i;
+        int hi = i + 1 < (int)params.size() ? i + 1 : i;
+        S ds = lengths[hi] - lengths[lo];
+        return ds > 0 ? (params[hi] - params[lo]) / ds : S(0);
+    }
+
+public:
+    void clear()
+    {
+        params.clear();
+        lengths.clear();
+    }
+
+    void build(const vec2<S>* points, const S* ts, int n, bool linear = false)
+    {
+        params.assign(ts, ts + n);
+        measure(points, n, linear);
+    }
+
+    //samples taken at parameters evenly spaced over [0, 1]
+    void build(const vec2<S>* points, int n, bool linear = false)
+    {
+        params.resize(n);
+        for(int i=0; i<n; i++)
+            params[i] = n > 1 ? S(i) / S(n - 1) : S(0);
+        measure(points, n, linear);
+    }
+
+    bool empty() const
+    {
+        return params.size() < 2;
+    }
+
+    S totalLength() const
+    {
+        return lengths.empty() ? S(0) : lengths.back();
+    }
+
+    //the samples bracketing distance, and how far between them it falls
+    void locate(S distance, int& segment, S& fraction) const
+    {
+        int n = lengths.size();
+        distance = std::max(S(0), std::min(distance, totalLength()));
+        segment = int(std::upper_bound(lengths.begin(), lengths.end(), distance) - lengths.begin()) - 1;
+        segment = std::max(0, std::min(segment, n - 2));
+        S span = lengths[segment + 1] - lengths[segment];
+        fraction = span > 0 ? (distance - lengths[segment]) / span : S(0);
+    }
+
+    S parameterAt(S distance) const
+    {
+        if(empty())
+            return params.empty() ? S(0) : params[0];
+        int i;
+        S u;
+        locate(distance, i, u);
+        S h = lengths[i + 1] - lengths[i];
+        S t0 = params[i];
+        S t1 = params[i + 1];
+        if(linear)
+            return t0 + (t1 - t0) * u;
+        //Hermite basis, with the end slopes scaled to the bracket
+        S u2 = u * u;
+        S u3 = u2 * u;
+        S t = (2*u3 - 3*u2 + 1) * t0
+            + (u3 - 2*u2 + u) * h * slopeAt(i)
+            + (-2*u3 + 3*u2) * t1
+            + (u3 - u2) * h * slopeAt(i + 1);
+        //the cubic can overshoot where the speed changes sharply
+        return std::max(t0, std::min(t, t1));
+    }
+
+    //count parameters evenly spaced in distance from start to end
+    void evenParameters(int count, S* out) const
+    {
+        S step = count > 1 ? totalLength() / (count - 1) : S(0);
+        for(int k=0; k<count; k++)
+            out[k] = parameterAt(step * k);
+    }
+};
@@ -0,0 +1,77 @@
+//
+//  arena.h
+//  CurvesEditor
+//
+//  Bump allocator for temporaries that live for one frame or one input
+//  event. allocate() is a pointer bump; reset() releases everything at
+//  once. If a cycle outgrows the buffer the overflow is served from the
+//  heap, and the next reset() grows the buffer to that high-water mark,
+//  so a steady workload stops touching the heap after its first cycle.
+//
+//  Only trivially destructible types: nothing is ever destroyed.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <new>
+#include <vector>
+
+class Arena
+{
+    char *buffer;
+    size_t capacity;
+    size_t used;
+    //bytes asked for this cycle, including what spilled to the heap
+    size_t demand;
+    std::vector<void*> overflow;
+
+    static size_t alignUp(size_t n)
+    {
+        const size_t alignment = 16;
+        return (n + alignment - 1) & ~(alignment - 1);
+    }
+
+public:
+    explicit Arena(size_t capacity):capacity(alignUp(capacity)),used(0),demand(0)
+    {
+        buffer = (char*)::operator new(this->capacity);
+        overflow.reserve(16);
+    }
+
+    ~Arena()
+    {
+        reset();
+        ::operator delete(buffer);
+    }
+
+    template <class T>
+    T* allocate(size_t count)
+    {
+        size_t size = alignUp(count * sizeof(T));
+        demand += size;
+        if(used + size <= capacity){
+            T *p = (T*)(buffer + used);
+            used += size;
+            return p;
+        }
+        //through operator new, so the allocation audit sees spills
+        void *p = ::operator new(size);
+        overflow.push_back(p);
+        return (T*)p;
+    }
+
+    void reset()
+    {
+        for(unsigned int i=0; i<overflow.size(); i++)
+            ::operator delete(overflow[i]);
+        overflow.clear();
+        if(demand > capacity){
+            ::operator delete(buffer);
+            capacity = alignUp(demand + demand / 2);
+            buffer = (char*)::operator new(capacity);
+        }
+        used = 0;
+        demand = 0;
+    }
+};
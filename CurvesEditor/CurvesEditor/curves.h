@@ -5,10 +5,416 @@
 //  Created by Kevin Donahoe on 10/5/15.
 //  Copyright (c) 2015 Kevin Donahoe. All rights reserved.
 //
+//  The curve classes are templated on their scalar type: the editor runs
+//  them in float (see the typedefs at the bottom), double is there for
+//  high-degree Lagrange curves that need the precision. The evaluators are
+//  also templated on the parameter type, so the same code evaluates one
+//  parameter or a floatx4 worth of them at once.
+//
 
 #ifndef __CurvesEditor__curves__
 #define __CurvesEditor__curves__
 
 #include <stdio.h>
+#include <vector>
+#include <algorithm>
+#include "float2.h"
+#include "affine2.h"
+#include "arclength.h"
+
+template <class S>
+class CurveT {
+public:
+    typedef vec2<S> point;
+
+    virtual ~CurveT(){}
+
+    virtual point getPoint(S t)=0;
+
+    //evaluates n parameters at once; the default just calls getPoint
+    virtual void getPoints(const S* ts, point* out, int n){
+        for(int i=0; i<n; i++)
+            out[i] = getPoint(ts[i]);
+    }
+
+    //appends the line strip the curve is drawn with
+    virtual void tessellate(std::vector<point>& strip){
+        S ts[101];
+        for (int i = 0; i <= 100; i++) {
+            ts[i] = S(i) / S(100);
+        }
+        size_t first = strip.size();
+        strip.resize(first + 101);
+        getPoints(ts, &strip[first], 101);
+    }
+
+    //appends a strip that stays within tolerance of the curve, splitting in t
+    //until the midpoint of every piece is that close to its chord
+    virtual void tessellateTo(S tolerance, std::vector<point>& strip){
+        point start = getPoint(0);
+        strip.push_back(start);
+        subdivide(S(0), start, S(1), getPoint(1), tolerance, 0, strip);
+    }
+
+private:
+    void subdivide(S t0, point p0, S t1, point p1, S tolerance, int depth, std::vector<point>& strip){
+        S tm = (t0 + t1) / 2;
+        point pm = getPoint(tm);
+        point chord = p1 - p0;
+        point offset = pm - p0;
+        //squared distance of the midpoint from the chord
+        S cross = chord.x * offset.y - chord.y * offset.x;
+        S chordLength2 = chord.norm2();
+        S distance2 = chordLength2 > 0 ? cross * cross / chordLength2 : offset.norm2();
+        //always split a couple of times so an S shape cannot pass as a straight line
+        if(depth >= 16 || (depth >= 2 && distance2 <= tolerance * tolerance)){
+            strip.push_back(p1);
+            return;
+        }
+        subdivide(t0, p0, tm, pm, tolerance, depth + 1, strip);
+        subdivide(tm, pm, t1, p1, tolerance, depth + 1, strip);
+    }
+
+};
+
+
+
+enum CurveType {
+    POLYLINE_CURVE,
+    BEZIER_CURVE,
+    LAGRANGE_CURVE,
+    CURVE_TYPE_COUNT
+};
+
+
+template <class S>
+class FreeformT : public CurveT<S>
+{
+public:
+    typedef vec2<S> point;
+
+protected:
+    std::vector<point> controlPoints;
+    //bumped on every edit so the render copy knows when to rebuild
+    unsigned int revision = 0;
+    
+    ArcLengthTable<S> arcLength;
+    //revision the table was built for; it is rebuilt on first use after an edit
+    unsigned int arcLengthRevision = ~0u;
+
+    //rebuilds arcLength from samples of the curve; they live on the stack, so
+    //the rebuild after every edit does not touch the heap
+    virtual void buildArcLength(){
+        const int samples = 256;
+        S ts[samples];
+        point points[samples];
+        for(int i=0; i<samples; i++)
+            ts[i] = S(i) / S(samples - 1);
+        this->getPoints(ts, points, samples);
+        arcLength.build(points, ts, samples);
+    }
+
+    //evaluates four parameters per pass with the subclass's evaluate()
+    template <class Curve>
+    static void getPointsInLanes(Curve *curve, const S* ts, point* out, int n){
+        typedef lanes<S, 4> batch;
+        int i = 0;
+        for(; i + 4 <= n; i += 4){
+            vec2<batch> r = curve->evaluate(batch::load(ts + i));
+            for(int lane=0; lane<4; lane++)
+                out[i + lane] = point(r.x.v[lane], r.y.v[lane]);
+        }
+        for(; i < n; i++)
+            out[i] = curve->evaluate(ts[i]);
+    }
+
+public:
+    const CurveType type;
+
+    FreeformT(CurveType type):type(type){}
+
+    virtual point getPoint(S t)=0;
+    virtual void addControlPoint(point p)
+    {
+
+        controlPoints.push_back(p);
+        controlPoints.at(controlPoints.size()-1).x = p.x;
+        controlPoints.at(controlPoints.size()-1).y = p.y;
+        revision++;
+
+    }
+
+    unsigned int getRevision(){
+        return revision;
+    }
+
+    const ArcLengthTable<S>& arcLengthTable(){
+        if(arcLengthRevision != revision){
+            buildArcLength();
+            arcLengthRevision = revision;
+        }
+        return arcLength;
+    }
+
+    //samples evenly spaced along the curve rather than in the parameter,
+    //so the strip does not bunch up where the curve slows down
+    void tessellate(std::vector<point>& strip){
+        const ArcLengthTable<S>& table = arcLengthTable();
+        if(table.totalLength() <= 0){
+            CurveT<S>::tessellate(strip);
+            return;
+        }
+        S ts[101];
+        table.evenParameters(101, ts);
+        size_t first = strip.size();
+        strip.resize(first + 101);
+        this->getPoints(ts, &strip[first], 101);
+    }
+
+    int numControlPoints(){
+        return controlPoints.size();
+    }
+
+    const std::vector<point>& getCPoints(){
+        return controlPoints;
+    }
+
+    void deleteCPoint(int index){
+        controlPoints.erase((controlPoints.begin()+index));
+        revision++;
+
+    }
+
+    void moveCPoint(int index, point p){
+        controlPoints.at(index) = p;
+        revision++;
+    }
+
+    //moves, rotates or scales every control point in one pass
+    void transform(const affine2<S>& m){
+        if(controlPoints.empty())
+            return;
+        transformPoints(m, &controlPoints[0], controlPoints.size());
+        revision++;
+    }
+
+    //control points become m applied to from, which holds numControlPoints() points
+    void transformFrom(const point* from, const affine2<S>& m){
+        if(controlPoints.empty())
+            return;
+        std::copy(from, from + controlPoints.size(), controlPoints.begin());
+        transformPoints(m, &controlPoints[0], controlPoints.size());
+        revision++;
+    }
+
+    //empties the curve for reuse from the scene's pool, keeping the point storage
+    virtual void reset(){
+        controlPoints.clear();
+        revision++;
+    }
+
+};
+
+
+template <class S>
+class PolylineT : public FreeformT<S>
+{
+public:
+    typedef vec2<S> point;
+
+    PolylineT():FreeformT<S>(POLYLINE_CURVE){}
+
+    //t runs over the segments in turn, each taking an equal share
+    point getPoint(S t){
+        const std::vector<point>& controlPoints = this->controlPoints;
+        int n = controlPoints.size();
+        if(n == 0)
+            return point(0.0, 0.0);
+        if(n == 1)
+            return controlPoints[0];
+        S position = std::max(S(0), std::min(t, S(1))) * S(n - 1);
+        int i = std::min(int(position), n - 2);
+        S u = position - S(i);
+        return controlPoints[i] + (controlPoints[i+1] - controlPoints[i]) * u;
+    }
+
+    void addControlPoint(point p)
+    {
+        this->controlPoints.push_back(p);
+        this->revision++;
+    }
+
+    void tessellate(std::vector<point>& strip){
+        if(this->controlPoints.size()>1){
+            strip.insert(strip.end(), this->controlPoints.begin(), this->controlPoints.end());
+        }
+
+    }
+
+    //the corners are already exact
+    void tessellateTo(S tolerance, std::vector<point>& strip){
+        strip.insert(strip.end(), this->controlPoints.begin(), this->controlPoints.end());
+    }
+
+protected:
+    //straight from the corners, which sit at evenly spaced t; the segments
+    //between them are straight, so interpolating linearly is exact
+    void buildArcLength(){
+        int n = this->controlPoints.size();
+        if(n < 2)
+            this->arcLength.clear();
+        else
+            this->arcLength.build(&this->controlPoints[0], n, true);
+    }
+
+};
+
+
+template <class S>
+class BezierCurveT : public FreeformT<S>
+{
+    //control point i premultiplied by n choose i, so evaluating leaves only
+    //the powers of t and 1-t; rebuilt on first use after an edit
+    std::vector<vec2<S> > scaledPoints;
+    unsigned int scaledRevision = ~0u;
+
+    void prepare(){
+        if(scaledRevision == this->revision)
+            return;
+        const std::vector<vec2<S> >& controlPoints = this->controlPoints;
+        int n = controlPoints.size() - 1;
+        scaledPoints.resize(controlPoints.size());
+        S choose = 1;
+        for (int i = 0; i <= n; i++) {
+            if(i > 0)
+                choose = choose * S(n - i + 1) / S(i);
+            scaledPoints[i] = controlPoints[i] * choose;
+        }
+        scaledRevision = this->revision;
+    }
+
+    public :
+    typedef vec2<S> point;
+
+    BezierCurveT():FreeformT<S>(BEZIER_CURVE){}
+
+    //U is S, or lanes of S to evaluate several parameters at once.
+    //Bernstein form in Horner order: the sum so far is multiplied by (1-t)
+    //as each scaled point comes in weighted by t^i, so a sample is O(n).
+    //Expects prepare() to have run, as getPoint and getPoints make sure of.
+    template <class U>
+    vec2<U> evaluate(U t)
+    {
+        int n = scaledPoints.size() - 1;
+        if(n < 0)
+            return vec2<U>();
+        if(n == 0)
+            return vec2<U>(scaledPoints[0]);
+        U s = U(1) - t;
+        U power = U(1);
+        vec2<U> r = vec2<U>(scaledPoints[0]) * s;
+        for (int i = 1; i < n; i++) {
+            power *= t;
+            r = (r + vec2<U>(scaledPoints[i]) * power) * s;
+        }
+        return r + vec2<U>(scaledPoints[n]) * (power * t);
+    }
+
+    point getPoint(S t)
+    {
+        prepare();
+        return evaluate(t);
+    }
+
+    void getPoints(const S* ts, point* out, int n){
+        prepare();
+        this->getPointsInLanes(this, ts, out, n);
+    }
+};
+
+
+template <class S>
+class LargrangeT : public FreeformT<S>
+{
+    //evenly spaced over [0,1], one per control point
+    std::vector<S> knots;
+    //barycentric weights, 1 / prod over k != j of (knots[j] - knots[k]) up to a
+    //common factor; they only depend on the number of knots
+    std::vector<S> weights;
+
+    //on first use after the number of control points changed; the storage is reused
+    void rebuildKnots(){
+        int n = this->controlPoints.size();
+        if(knots.size() == n)
+            return;
+        knots.resize(n);
+        weights.resize(n);
+        //for even spacing the weights are (-1)^j (n-1 choose j)
+        S choose = 1;
+        for(int j=0; j<n; j++){
+            knots[j] = n > 1 ? j / S(n-1) : S(0);
+            if(j > 0)
+                choose = choose * S(n - j) / S(j);
+            weights[j] = j % 2 == 0 ? choose : -choose;
+        }
+    }
+
+    public :
+        typedef vec2<S> point;
+
+        LargrangeT():FreeformT<S>(LAGRANGE_CURVE){}
+
+        //after deleteCPoint; the knots also catch up by themselves on the next evaluation
+        void eraseCP(){
+            this->revision++;
+            rebuildKnots();
+        }
+
+        void reset(){
+            FreeformT<S>::reset();
+            knots.clear();
+            weights.clear();
+        }
+
+    //barycentric form: the knot products are folded into the weights, so a
+    //sample costs O(n) instead of O(n^2). Expects rebuildKnots() to have run.
+    point evaluate(S t)
+    {
+        const std::vector<point>& controlPoints = this->controlPoints;
+        point numerator;
+        S denominator = 0;
+        for (unsigned int j = 0; j < knots.size(); j++) {
+            S d = t - knots[j];
+            //the curve passes through its points; the formula divides by zero there
+            if(d == 0)
+                return controlPoints[j];
+            S w = weights[j] / d;
+            numerator += controlPoints[j] * w;
+            denominator += w;
+        }
+        return knots.empty() ? point() : numerator * (S(1) / denominator);
+    }
+
+    point getPoint(S t)
+    {
+        rebuildKnots();
+        return evaluate(t);
+    }
+
+    //the exact-knot test needs a branch per sample, so no lanes here
+    void getPoints(const S* ts, point* out, int n){
+        rebuildKnots();
+        for(int i=0; i<n; i++)
+            out[i] = evaluate(ts[i]);
+    }
+};
+
+
+//the editor works in float
+typedef CurveT<float> Curve;
+typedef FreeformT<float> Freeform;
+typedef PolylineT<float> Polyline;
+typedef BezierCurveT<float> BezierCurve;
+typedef LargrangeT<float> Largrange;
 
 #endif /* defined(__CurvesEditor__curves__) */
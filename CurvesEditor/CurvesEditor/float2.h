@@ -1,94 +1,179 @@
 #pragma once
 
-#include <math.h>
+#include <cmath>
+#include <stdlib.h>
 
-class float2
+//N values of S processed side by side, e.g. a curve evaluated at N parameters
+//at once. Plain fixed-size loops, which the compiler turns into SIMD code.
+template <class S, int N>
+class lanes
 {
 public:
-    float x;
-    float y;
-    
-    float2()
+    S v[N];
+
+    lanes(){}
+
+    //broadcast
+    lanes(S s)
+    {
+        for(int i=0; i<N; i++) v[i] = s;
+    }
+
+    static lanes load(const S* p)
+    {
+        lanes r;
+        for(int i=0; i<N; i++) r.v[i] = p[i];
+        return r;
+    }
+
+    void store(S* p) const
+    {
+        for(int i=0; i<N; i++) p[i] = v[i];
+    }
+
+    friend lanes operator-(const lanes& a)
+    {
+        lanes r;
+        for(int i=0; i<N; i++) r.v[i] = -a.v[i];
+        return r;
+    }
+
+    friend lanes operator+(const lanes& a, const lanes& b)
+    {
+        lanes r;
+        for(int i=0; i<N; i++) r.v[i] = a.v[i] + b.v[i];
+        return r;
+    }
+
+    friend lanes operator-(const lanes& a, const lanes& b)
+    {
+        lanes r;
+        for(int i=0; i<N; i++) r.v[i] = a.v[i] - b.v[i];
+        return r;
+    }
+
+    friend lanes operator*(const lanes& a, const lanes& b)
+    {
+        lanes r;
+        for(int i=0; i<N; i++) r.v[i] = a.v[i] * b.v[i];
+        return r;
+    }
+
+    friend lanes operator/(const lanes& a, const lanes& b)
+    {
+        lanes r;
+        for(int i=0; i<N; i++) r.v[i] = a.v[i] / b.v[i];
+        return r;
+    }
+
+    friend lanes sqrt(const lanes& a)
     {
-        x = 0.0f;
-        y = 0.0f;
+        lanes r;
+        for(int i=0; i<N; i++) r.v[i] = std::sqrt(a.v[i]);
+        return r;
     }
-    
-    
-    float2(float x, float y):x(x),y(y){}
-    
-    float2 operator-() const
+
+    void operator+=(const lanes& a) { *this = *this + a; }
+    void operator-=(const lanes& a) { *this = *this - a; }
+    void operator*=(const lanes& a) { *this = *this * a; }
+    void operator/=(const lanes& a) { *this = *this / a; }
+};
+
+typedef lanes<float, 4> floatx4;
+
+
+template <class S>
+class vec2
+{
+public:
+    S x;
+    S y;
+
+    constexpr vec2():x(0),y(0){}
+
+    constexpr vec2(S x, S y):x(x),y(y){}
+
+    //converts between precisions, e.g. double2(somefloat2)
+    template <class U>
+    constexpr explicit vec2(const vec2<U>& v):x(v.x),y(v.y){}
+
+    constexpr vec2 operator-() const
     {
-        return float2(-x, -y);
+        return vec2(-x, -y);
     }
-    
-    
-    float2 operator+(const float2& addOperand) const
+
+
+    constexpr vec2 operator+(const vec2& addOperand) const
     {
-        return float2(x + addOperand.x, y + addOperand.y);
+        return vec2(x + addOperand.x, y + addOperand.y);
     }
-    
-    float2 operator-(const float2& operand) const
+
+    constexpr vec2 operator-(const vec2& operand) const
     {
-        return float2(x - operand.x, y - operand.y);
+        return vec2(x - operand.x, y - operand.y);
     }
-    
-    float2 operator*(const float2& operand) const
+
+    constexpr vec2 operator*(const vec2& operand) const
     {
-        return float2(x * operand.x, y * operand.y);
+        return vec2(x * operand.x, y * operand.y);
     }
-    
-    float2 operator*(float operand) const
+
+    constexpr vec2 operator*(S operand) const
     {
-        return float2(x * operand, y * operand);
+        return vec2(x * operand, y * operand);
     }
-    
-    void operator-=(const float2& a)
+
+    void operator-=(const vec2& a)
     {
         x -= a.x;
         y -= a.y;
     }
-    
-    void operator+=(const float2& a)
+
+    void operator+=(const vec2& a)
     {
         x += a.x;
         y += a.y;
     }
-    
-    void operator*=(const float2& a)
+
+    void operator*=(const vec2& a)
     {
         x *= a.x;
         y *= a.y;
     }
-    
-    void operator*=(float a)
+
+    void operator*=(S a)
     {
         x *= a;
         y *= a;
     }
-    
-    float norm()
+
+    S norm() const
     {
-        return sqrtf(x*x+y*y);
+        //std::sqrt keeps float in float; lanes find their own sqrt by lookup
+        using std::sqrt;
+        return sqrt(norm2());
     }
-    
-    float norm2()
+
+    constexpr S norm2() const
     {
         return x*x+y*y;
     }
-    
-    float2 normalize()
+
+    //unit vector in the same direction; the receiver is left alone
+    vec2 normalized() const
     {
-        float oneOverLength = 1.0f / norm();
-        x *= oneOverLength;
-        y *= oneOverLength;
-        return *this;
+        return *this * (S(1) / norm());
     }
-    
-    static float2 random()
+
+    static vec2 random()
     {
-        return float2(
-                      ((float)rand() / RAND_MAX) * 2 - 1,
-                      ((float)rand() / RAND_MAX) * 2 - 1);
+        return vec2(
+                      S(((float)rand() / RAND_MAX) * 2 - 1),
+                      S(((float)rand() / RAND_MAX) * 2 - 1));
     }
-};
\ No newline at end of file
+};
+
+typedef vec2<float> float2;
+typedef vec2<double> double2;
+//four points in structure-of-arrays form
+typedef vec2<floatx4> float2x4;
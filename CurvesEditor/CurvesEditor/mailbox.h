@@ -0,0 +1,69 @@
+//
+//  mailbox.h
+//  CurvesEditor
+//
+//  Single-slot, lock-free hand-over of heap objects from one producer
+//  thread to one consumer thread. Every object is owned by exactly one
+//  side at a time: the producer until publish, the mailbox until take,
+//  the consumer afterwards. A value the consumer never took is deleted
+//  when the next one is published, so the consumer only ever sees the
+//  newest.
+//
+//  ReturnStack goes the other way: any thread hands objects back and one
+//  thread takes everything returned so far in a single exchange.
+//
+
+#pragma once
+
+#include <atomic>
+
+template <class T>
+class Mailbox
+{
+    std::atomic<T*> pending;
+
+public:
+    Mailbox():pending(nullptr){}
+
+    ~Mailbox()
+    {
+        delete pending.load();
+    }
+
+    void publish(T* value)
+    {
+        T* stale = pending.exchange(value, std::memory_order_acq_rel);
+        delete stale;
+    }
+
+    //newest value since the last take, or nullptr; the caller owns it
+    T* take()
+    {
+        return pending.exchange(nullptr, std::memory_order_acq_rel);
+    }
+};
+
+//lock-free stack; T links itself through a `T* nextReturned` member, so
+//pushing never allocates. Taking the whole stack at once sidesteps ABA.
+template <class T>
+class ReturnStack
+{
+    std::atomic<T*> head;
+
+public:
+    ReturnStack():head(nullptr){}
+
+    void push(T* value)
+    {
+        T* top = head.load(std::memory_order_relaxed);
+        do
+            value->nextReturned = top;
+        while(!head.compare_exchange_weak(top, value, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    //everything pushed since the last take, newest first, linked through nextReturned
+    T* takeAll()
+    {
+        return head.exchange(nullptr, std::memory_order_acquire);
+    }
+};
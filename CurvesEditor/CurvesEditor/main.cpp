@@ -10,7 +10,15 @@
 #define _USE_MATH_DEFINES
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 #include <vector>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <chrono>
 
 #if defined(WIN32) || defined(_WIN32) || defined(__WIN32__)
 // Needed on MsWindows
@@ -19,6 +27,14 @@
 
 #include <OpenGL/gl.h>
 #include "float2.h"
+#include "curves.h"
+#include "affine2.h"
+#include "stroke.h"
+#include "service.h"
+#include "slotmap.h"
+#include "mailbox.h"
+#include "arena.h"
+#include "allocaudit.h"
 #include <OpenGL/glu.h>
 // Download glut from: http://www.opengl.org/resources/libraries/glut/
 #include <GLUT/glut.h>
@@ -28,250 +44,497 @@ bool bPressed = false;
 bool aPressed = false;
 bool dPressed = false;
 bool lPressed = false;
+bool mPressed = false;
+bool rPressed = false;
+bool sPressed = false;
 bool nonePressed = true;
+//seconds since start, drives the markers
 float t = 0;
 
+//markers travel along every curve at constant speed while n toggles them on
+bool showMarkers = false;
+const float markerSpacing = 0.1f;
+const float markerSpeed = 0.25f;
+
+//stroke widths in pixels
+const float thinStrokeWidth = 2.5f;
+const float thickStrokeWidth = 8.0f;
+
+//window size in pixels, kept up to date by onReshape; stroke meshes are built for it
+int viewportWidth = 640;
+int viewportHeight = 480;
+
+//temporaries of one frame, on the GLUT thread; reset by prepareFrame
+Arena frameArena(1 << 20);
+//temporaries of one input event or snapshot, on the edit thread
+Arena eventArena(1 << 16);
+
 //int clickX = 0;
 //int clickY = 0;
 
-class Curve {
+//appends the triangles of a strip in normalized device coordinates, stroked
+//width pixels wide in a viewport of the given size. The offsets are worked out
+//in pixels, where both axes have the same scale, so the width is the same in
+//every direction and caps and joins come out round.
+void strokeInPixels(const float2 *strip, int n, float width, StrokeJoin join,
+                    int viewportW, int viewportH, float2 *scratch, std::vector<float2>& triangles){
+    float2 halfSize(std::max(viewportW, 1) / 2.0f, std::max(viewportH, 1) / 2.0f);
+    std::copy(strip, strip + n, scratch);
+    transformPoints(affine2<float>::scaling(halfSize, float2()), scratch, n);
+    size_t first = triangles.size();
+    buildStroke(scratch, n, width, join, true, triangles);
+    if(triangles.size() > first)
+        transformPoints(affine2<float>::scaling(float2(1 / halfSize.x, 1 / halfSize.y), float2()),
+                        &triangles[first], triangles.size() - first);
+}
+
+//copy of a curve as the render thread sees it. It does not change while any
+//snapshot holds it; afterwards the edit thread rebuilds it for another edit.
+class RenderCurve
+{
 public:
-    virtual float2 getPoint(float t)=0;
-    
-    virtual void draw(){
-        glBegin(GL_LINE_STRIP);
-        for (float i = 0; i < 1; i+=.01) {
-            float2 point = getPoint(i);
-            float x = point.x;
-            float y = point.y;
-            glVertex2d(x, y);
-            
+    //revision of the curve this was built from
+    unsigned int revision = 0;
+    CurveType type = POLYLINE_CURVE;
+    std::vector<float2> controlPoints;
+    std::vector<float2> strip;
+    //over the strip vertices, parameterized by vertex index
+    ArcLengthTable<float> stripLength;
+    
+    //refills this from curve, keeping the storage of the vectors and meshes
+    void rebuild(Freeform *curve){
+        revision = curve->getRevision();
+        type = curve->type;
+        const std::vector<float2>& points = curve->getCPoints();
+        controlPoints.assign(points.begin(), points.end());
+        strip.clear();
+        curve->tessellate(strip);
+        if(strip.size() > 1){
+            float *indices = eventArena.allocate<float>(strip.size());
+            for(unsigned int i=0; i<strip.size(); i++)
+                indices[i] = i;
+            stripLength.build(&strip[0], indices, strip.size());
+        }
+        else{
+            stripLength.clear();
+        }
+        for(int i=0; i<2; i++)
+            strokeMeshes[i].width = -1;
+    }
+    
+    //the strip is straight between vertices, so interpolating them is exact
+    float2 pointAtDistance(float distance) const {
+        int i;
+        float u;
+        stripLength.locate(distance, i, u);
+        return strip[i] + (strip[i+1] - strip[i]) * u;
+    }
+    
+    //upper bound on what placeMarkers writes, whatever the time
+    int maxMarkers() const {
+        return int(stripLength.totalLength() / markerSpacing) + 1;
+    }
+    
+    //writes the marker positions at time to out and returns how many
+    int placeMarkers(float time, float2 *out) const {
+        float length = stripLength.totalLength();
+        if(length <= 0)
+            return 0;
+        float offset = fmodf(time * markerSpeed, markerSpacing);
+        int limit = maxMarkers();
+        int count = 0;
+        for(float d = offset; d < length && count < limit; d += markerSpacing)
+            out[count++] = pointAtDistance(d);
+        return count;
+    }
+    
+    //triangles of the strip at width pixels, cached per width and rebuilt when
+    //the window size changes. Only the render thread draws, so the lazily built
+    //meshes need no lock.
+    const std::vector<float2>& stroke(float width) const {
+        //the mesh of this width, else the one not asked for last
+        int slot = 1 - lastStroke;
+        for(int i=0; i<2; i++)
+            if(strokeMeshes[i].width == width)
+                slot = i;
+        StrokeMesh &mesh = strokeMeshes[slot];
+        if(mesh.width != width || mesh.viewportWidth != viewportWidth || mesh.viewportHeight != viewportHeight){
+            mesh.triangles.clear();
+            if(!strip.empty()){
+                //polyline corners are sharp on purpose, everything else is smooth
+                StrokeJoin join = type == POLYLINE_CURVE ? MITER_JOIN : ROUND_JOIN;
+                float2 *scratch = frameArena.allocate<float2>(strip.size());
+                strokeInPixels(&strip[0], strip.size(), width, join, viewportWidth, viewportHeight,
+                               scratch, mesh.triangles);
+            }
+            mesh.width = width;
+            mesh.viewportWidth = viewportWidth;
+            mesh.viewportHeight = viewportHeight;
         }
-        glEnd();
+        lastStroke = slot;
+        return mesh.triangles;
     }
     
+private:
+    struct StrokeMesh {
+        float width = -1;
+        int viewportWidth = 0;
+        int viewportHeight = 0;
+        std::vector<float2> triangles;
+    };
+    //a curve is drawn thin or thick, so two meshes cover selecting and deselecting it
+    mutable StrokeMesh strokeMeshes[2];
+    mutable int lastStroke = 0;
+    
+public:
+    //snapshots and scene entries holding this, see RenderCurveRef
+    std::atomic<int> refs{0};
+    //link in returnedRenderCurves
+    RenderCurve *nextReturned = nullptr;
 };
 
+//render curves no longer held by anything, on their way back to the edit thread
+ReturnStack<RenderCurve> returnedRenderCurves;
 
-
-class Freeform : public Curve
+//counted reference to a RenderCurve. Dropping the last one, on whichever
+//thread, returns the curve to the edit thread to be rebuilt, not freed.
+class RenderCurveRef
 {
-protected:
-    std::vector<float2> controlPoints;
-public:
-    bool selected = false;
-    bool isPolyLine = false;
-    bool isLagrange = false;
- 
+    RenderCurve *curve;
     
-    virtual float2 getPoint(float t)=0;
-    virtual void addControlPoint(float2 p)
-    {
-        
-        controlPoints.push_back(p);
-        controlPoints.at(controlPoints.size()-1).x = p.x;
-        controlPoints.at(controlPoints.size()-1).y = p.y;
-
+    void retain(){
+        if(curve != nullptr)
+            curve->refs.fetch_add(1, std::memory_order_relaxed);
     }
     
-    
-    void drawControlPoints(){
-        for(int i=0; i<controlPoints.size(); i++){
-            
-            glBegin(GL_POINTS);
-            float2 point = controlPoints[i];
-            glVertex2d(point.x, point.y);
-            glEnd();
-        }
+    void release(){
+        if(curve != nullptr && curve->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            returnedRenderCurves.push(curve);
     }
     
-    int numControlPoints(){
-        return controlPoints.size();
-    }
+public:
+    RenderCurveRef():curve(nullptr){}
+    explicit RenderCurveRef(RenderCurve *curve):curve(curve){ retain(); }
+    RenderCurveRef(const RenderCurveRef& other):curve(other.curve){ retain(); }
+    ~RenderCurveRef(){ release(); }
     
-    std::vector<float2> getCPoints(){
-        return controlPoints;
+    RenderCurveRef& operator=(const RenderCurveRef& other){
+        //the copy releases what this held
+        RenderCurveRef copy(other);
+        std::swap(curve, copy.curve);
+        return *this;
     }
     
-    void deleteCPoint(int index){
-        controlPoints.erase((controlPoints.begin()+index));
-        
+    void reset(){
+        release();
+        curve = nullptr;
     }
     
+    const RenderCurve *get() const { return curve; }
+    const RenderCurve *operator->() const { return curve; }
+    explicit operator bool() const { return curve != nullptr; }
 };
 
 
-class Polyline : public Freeform
+//what one frame draws; curves that did not change are shared with the previous snapshot.
+//Snapshots go back and forth between the threads and are refilled, never freed.
+class SceneSnapshot
 {
 public:
-    float2 getPoint(float t){
-        return float2(0.0, 0.0);
-    }
-    
-    void addControlPoint(float2 p)
-    {
-        controlPoints.push_back(p);
-    }
+    std::vector<RenderCurveRef> curves;
+    RenderCurveRef selected;
+    //parallel to curves: selected or grouped, drawn thick
+    std::vector<bool> highlighted;
+    bool showMarkers = false;
     
-    void draw(){
-        if(controlPoints.size()>1){
-            for(int i = 0; i < controlPoints.size()-1; i++){
-                glBegin(GL_LINE_STRIP);
-                float2 point1 = controlPoints[i];
-                float2 point2 = controlPoints[i+1];
-                glVertex2d(point1.x, point1.y);
-                glVertex2d(point2.x, point2.y);
+    //the stroke meshes of the highlighted curves, or of the others, in one frameArena block
+    const float2 *gatherStrokes(bool ofHighlighted, float width, int& count) const {
+        count = 0;
+        for(unsigned int i=0; i<curves.size(); i++)
+            if(highlighted[i] == ofHighlighted)
+                count += curves[i]->stroke(width).size();
+        float2 *out = frameArena.allocate<float2>(count);
+        float2 *next = out;
+        for(unsigned int i=0; i<curves.size(); i++){
+            if(highlighted[i] == ofHighlighted){
+                const std::vector<float2>& mesh = curves[i]->stroke(width);
+                next = std::copy(mesh.begin(), mesh.end(), next);
             }
-            glEnd();
         }
-        
+        return out;
     }
-    
 };
 
 
-class BezierCurve : public Freeform
+typedef SlotHandle CurveHandle;
+
+//owns every curve; handles stay valid until their curve is deleted
+class CurveScene
+
 {
-    //params of bernstein: index , number of control points -1, t (the curve parameter)
-    static double bernstein(int i, int n, double t) {
-        if(n == 1) {
-            if(i == 0) return 1-t;
-            if(i == 1) return t;
-            return 0;
+    struct SceneEntry {
+        Freeform *curve;
+        //last render copy published for this curve
+        RenderCurveRef render;
+    };
+    
+    SlotMap<SceneEntry> curves;
+    //deleted curves are parked here per type and handed out again by addCurve
+    std::vector<Freeform*> pool[CURVE_TYPE_COUNT];
+    //render copies nothing holds any more, per type, so their storage fits the next one
+    std::vector<RenderCurve*> renderPool[CURVE_TYPE_COUNT];
+    CurveHandle selected;
+    //curves added with shift-click; transforms apply to them along with the selected one
+    std::vector<CurveHandle> group;
+    
+    static Freeform* makeCurve(CurveType type) {
+        switch (type) {
+            case POLYLINE_CURVE:
+                return new Polyline;
+            case LAGRANGE_CURVE:
+                return new Largrange;
+            default:
+                return new BezierCurve;
         }
-        if(i < 0 || i > n) return 0;
-        return (1 - t) * bernstein(i,   n-1, t)
-        +      t  * bernstein(i-1, n-1, t);
     }
     
-    public :
-    
-    float2 getPoint(float t)
-    {
-        float2 r(0.0, 0.0);
-        float weight;
-        // for every control point
-        for (float i = 0; i < controlPoints.size(); i++) {
-            // compute weight using the Bernstein formula
-            weight = bernstein(i, controlPoints.size()-1, t);
-            r += controlPoints.at(i)*weight;
+    //a render copy of curve, rebuilt from a returned one when there is one
+    RenderCurveRef renderCopy(Freeform *curve){
+        RenderCurve *render;
+        if(renderPool[curve->type].empty()){
+            render = new RenderCurve;
+        }
+        else{
+            render = renderPool[curve->type].back();
+            renderPool[curve->type].pop_back();
         }
-        // add control point to r, weighted
-        return r;
+        render->rebuild(curve);
+        return RenderCurveRef(render);
     }
-};
-
-
-class Largrange : public Freeform
-{
-    //knot weights
-    std:: vector<float> knots;
     
-    //n is one less than the number of controlpoints
-    double lagranginate(int i, double t) {
-        
-        double numerator = 1;
-        double denominator = 1;
-        
-        for(int j=0; j<controlPoints.size(); j++)
-        {
-            
-            
-            if(j != i){
-                numerator *= (t - knots.at(j));
-                denominator *= (knots.at(i) - knots.at(j));
-          
-            }
-            
+    void collectReturnedRenders(){
+        RenderCurve *render = returnedRenderCurves.takeAll();
+        while(render != nullptr){
+            RenderCurve *next = render->nextReturned;
+            renderPool[render->type].push_back(render);
+            render = next;
         }
-        
-        return numerator / denominator;
     }
     
-    public :
-        void addControlPoint(float2 p){
-            controlPoints.push_back(p);
-            int controlPointsSize = controlPoints.size();
-            
-            knots.clear();
-            
-            if(controlPointsSize == 1){
-                knots.push_back(0);
-                return;
+public:
+    CurveHandle addCurve(CurveType type) {
+        Freeform *curve;
+        if(pool[type].empty()){
+            curve = makeCurve(type);
+        }
+        else{
+            curve = pool[type].back();
+            pool[type].pop_back();
+        }
+        SceneEntry entry;
+        entry.curve = curve;
+        return curves.insert(entry);
+    }
+    //destructor --> iterates through the list and the pools, and deletes them
+    ~CurveScene() {
+        for(int i=0; i<curves.size(); i++){
+            delete curves.at(i).curve;
+            curves.at(i).render.reset();
+        }
+        collectReturnedRenders();
+        for(int type=0; type<CURVE_TYPE_COUNT; type++){
+            for(unsigned int i=0; i<pool[type].size(); i++)
+                delete pool[type].at(i);
+            for(unsigned int i=0; i<renderPool[type].size(); i++)
+                delete renderPool[type].at(i);
+        }
+    }
+    //refills snapshot for the next frame, rebuilding only curves edited since the last one
+    void snapshot(SceneSnapshot *snapshot) {
+        snapshot->showMarkers = showMarkers;
+        snapshot->curves.clear();
+        snapshot->selected.reset();
+        collectReturnedRenders();
+        snapshot->highlighted.assign(curves.size(), false);
+        for(int i=0; i<curves.size(); i++){
+            SceneEntry &entry = curves.at(i);
+            if(!entry.render || entry.render->revision != entry.curve->getRevision()){
+                entry.render = renderCopy(entry.curve);
             }
-    
-            
-            for(int j=0; j<controlPointsSize; j++){
-                knots.push_back(j / (controlPoints.size()-1.0));
+            snapshot->curves.push_back(entry.render);
+            if(curves.handleAt(i) == selected){
+                snapshot->selected = entry.render;
+                snapshot->highlighted[i] = true;
+            }
+            else if(isGrouped(curves.handleAt(i))){
+                snapshot->highlighted[i] = true;
             }
         }
+    }
     
+    //O(1): swap-removes the curve and returns it to the pool
+    void deleteCurve(CurveHandle h){
+        SceneEntry *entry = curves.get(h);
+        if(entry == nullptr)
+            return;
+        entry->curve->reset();
+        pool[entry->curve->type].push_back(entry->curve);
+        curves.erase(h);
+    }
     
-        void eraseCP(){
-        
-            knots.clear();
+    Freeform *getCurve(CurveHandle h){
+        SceneEntry *entry = curves.get(h);
+        return entry == nullptr ? nullptr : entry->curve;
+    }
+    
+    int numCurves(){
+        return curves.size();
+    }
+    
+    Freeform *curveAt(int i){
+        return curves.at(i).curve;
+    }
+    
+    CurveHandle handleAt(int i){
+        return curves.handleAt(i);
+    }
 
-            if(controlPoints.size() == 1){
-                knots.push_back(0);
+    
+    void select(CurveHandle h){
+        selected = h;
+    }
+    
+    void deselect(){
+        selected = CurveHandle();
+    }
+    
+    CurveHandle selectedHandle(){
+        return selected;
+    }
+    
+    //nullptr if nothing is selected or the selected curve was deleted
+    Freeform *selectedCurve(){
+        return getCurve(selected);
+    }
+    
+    bool isSelected(CurveHandle h){
+        return curves.contains(h) && h == selected;
+    }
+    
+    //moves the selection to the next curve, wrapping around; selects the first if none is
+    void selectNext(){
+        if(curves.size() == 0)
+            return;
+        int next = curves.indexOf(selected) + 1;
+        if(next == curves.size())
+            next = 0;
+        selected = curves.handleAt(next);
+    }
+    
+    bool isGrouped(CurveHandle h){
+        for(unsigned int i=0; i<group.size(); i++)
+            if(group[i] == h)
+                return true;
+        return false;
+    }
+    
+    //adds the curve to the group, or takes it out if it is already in
+    void toggleGroup(CurveHandle h){
+        if(!curves.contains(h))
+            return;
+        for(unsigned int i=0; i<group.size(); i++){
+            if(group[i] == h){
+                group.erase(group.begin()+i);
                 return;
             }
-        
-            for(int j=0; j<controlPoints.size(); j++){
-                knots.push_back(j / (controlPoints.size()-1.0));
-            }
         }
+        group.push_back(h);
+    }
     
-    float2 getPoint(float t)
-    {
-        float2 r(0.0, 0.0);
-        float weight;
-        // for every control point
-        for (float i = 0; i < controlPoints.size(); i++) {
-            // compute weight using the Lagrange formula
-            weight = lagranginate(i, t);
-            
-            r += controlPoints.at(i)*weight;
-
+    void clearGroup(){
+        group.clear();
+    }
+    
+    //the selected curve plus the group, skipping deleted curves
+    void transformTargets(std::vector<CurveHandle>& targets){
+        targets.clear();
+        if(selectedCurve() != nullptr)
+            targets.push_back(selected);
+        for(unsigned int i=0; i<group.size(); i++){
+            if(curves.contains(group[i]) && group[i] != selected)
+                targets.push_back(group[i]);
         }
-        // add control point to r, weighted
-        
-        return r;
     }
 };
 
+CurveScene scene;
+
+//the curve currently being built while p, l or b is held down
+CurveHandle editingCurve;
+
+//the edit thread publishes here, onDisplay takes the newest
+Mailbox<SceneSnapshot> publishedSnapshot;
+//and onDisplay hands the one it replaced back here to be refilled
+Mailbox<SceneSnapshot> recycledSnapshot;
+//owned by the GLUT thread; redrawn until a newer snapshot arrives
+SceneSnapshot *renderSnapshot = new SceneSnapshot;
+
+
+//what onDisplay sends to GL this frame; the arrays live in frameArena or in the snapshot
+struct FramePlan {
+    //selected and grouped curves, one draw call
+    const float2 *thick;
+    int numThick;
+    //everything else, one draw call
+    const float2 *thin;
+    int numThin;
+    //of the selected curve
+    const float2 *controlPoints;
+    int numControlPoints;
+    const float2 *markers;
+    int numMarkers;
+};
 
-
-
-std::vector<Freeform*> curves;
-
-class CurveScene
-
-{
-public:
-    void addCurve(Freeform* curve) {
-        curves.push_back(curve);
-    }
-    //destructor --> iterates through the list, and deletes them
-    ~CurveScene() {
-        for(unsigned int i=0; i<curves.size(); i++)
-            delete curves.at(i);
-    }
-    void draw() {
-        for(unsigned int i=0; i<curves.size(); i++){
-            if(curves.at(i)->selected == false){
-                    curves.at(i)->draw();
-            }
-        }
-    }
+//everything a frame needs short of GL calls; allocates nothing once the meshes are built
+void prepareFrame(FramePlan& frame){
+    frameArena.reset();
     
-    void deleteCurve(int index){
-        curves.erase(curves.begin()+index);
+    SceneSnapshot *newest = publishedSnapshot.take();
+    if(newest != nullptr){
+        recycledSnapshot.publish(renderSnapshot);
+        renderSnapshot = newest;
     }
     
+    frame.thick = renderSnapshot->gatherStrokes(true, thickStrokeWidth, frame.numThick);
+    frame.thin = renderSnapshot->gatherStrokes(false, thinStrokeWidth, frame.numThin);
     
-};
+    const RenderCurve *selected = renderSnapshot->selected.get();
+    frame.numControlPoints = selected != nullptr ? selected->controlPoints.size() : 0;
+    frame.controlPoints = frame.numControlPoints > 0 ? &selected->controlPoints[0] : nullptr;
+    
+    frame.numMarkers = 0;
+    frame.markers = nullptr;
+    if(renderSnapshot->showMarkers){
+        const std::vector<RenderCurveRef>& curves = renderSnapshot->curves;
+        int capacity = 0;
+        for(unsigned int i=0; i<curves.size(); i++)
+            capacity += curves[i]->maxMarkers();
+        float2 *markers = frameArena.allocate<float2>(capacity);
+        for(unsigned int i=0; i<curves.size(); i++)
+            frame.numMarkers += curves[i]->placeMarkers(t, markers + frame.numMarkers);
+        frame.markers = markers;
+    }
+}
 
-CurveScene scene = *new CurveScene();
+
+void drawVertices(GLenum mode, const float2 *vertices, int count){
+    if(count == 0)
+        return;
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(2, GL_FLOAT, sizeof(float2), vertices);
+    glDrawArrays(mode, 0, count);
+    glDisableClientState(GL_VERTEX_ARRAY);
+}
 
 
 
@@ -279,31 +542,20 @@ void onDisplay(){
     glClearColor(0.3f, 0.8f, 1.0f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); // clear screen. color_buffer_bit needed, depth_buffer_bit not needed now but doesn't hurt
     
+    FramePlan frame;
+    prepareFrame(frame);
     
-    GLfloat lineWidth;
-    GLfloat widthSizes[2];
-    
-    widthSizes[0] = 10.0f;
-    widthSizes[1] = 20.0f;
-    glGetFloatv(GL_LINE_WIDTH_RANGE, widthSizes);
-    
-    lineWidth = widthSizes[1];
-    for(int i=0; i<curves.size(); i++){
-        if(curves.at(i)->selected){
-            glColor3d(0.0, 0.0, 1.0);
-            glPointSize(15);
-            curves.at(i)->drawControlPoints();
-            glColor3d(0.0, 0.0, 1.0);
-            glLineWidth(lineWidth);
-            curves.at(i)->draw();
-            glEnd();
-        }
-    }
+    glColor3d(0.0, 0.0, 1.0);
+    glPointSize(15);
+    drawVertices(GL_POINTS, frame.controlPoints, frame.numControlPoints);
+    drawVertices(GL_TRIANGLES, frame.thick, frame.numThick);
     
     glColor3d(1.0, 0.0, 0.0);
-    lineWidth = widthSizes[0];
-    glLineWidth(lineWidth);
-    scene.draw();
+    drawVertices(GL_TRIANGLES, frame.thin, frame.numThin);
+    
+    glColor3d(1.0, 1.0, 1.0);
+    glPointSize(6);
+    drawVertices(GL_POINTS, frame.markers, frame.numMarkers);
     
     
     glutSwapBuffers();
@@ -313,23 +565,9 @@ void onDisplay(){
 
 void onReshape(int winWidth0, int winHeight0) {
     glViewport(0, 0, winWidth0, winHeight0);
-}
-
-
-int indexCurveSelected(){
-    for(int i=0; i<curves.size(); i++){
-        if(curves.at(i)->selected){
-            return i;
-        }
-    }
-    //returns initial curve in curves if none are selected
-    return -1;
-}
-
-
-void deselectPreviouslySelected(){
-    if(indexCurveSelected() != -1)
-        curves.at(indexCurveSelected())->selected = false;
+    //stroke meshes built for the old size no longer match and rebuild on the next frame
+    viewportWidth = winWidth0;
+    viewportHeight = winHeight0;
 }
 
 
@@ -343,16 +581,28 @@ void deselectPreviouslySelected(){
 //}
 
 
+//drag state: a transform in progress, or a single control point being dragged
+bool transforming = false;
+float2 transformPivot;
+float2 transformStart;
+//every move places the targets relative to where they were when the drag
+//started, so a degenerate intermediate step (a scale of 0) is not compounded
+std::vector<CurveHandle> transformTargets;
+//control points of all targets at drag start, target after target, and how many each had
+std::vector<float2> transformStartPoints;
+std::vector<int> transformStartCounts;
+CurveHandle dragCurve;
+int dragPoint = -1;
+
+
 //Add a new instance of a curve every time a key is hit
-void onKeyboard(unsigned char key,int x, int y) {
+void editKeyboard(unsigned char key) {
     
     switch (key) {
         case 'p':{
             if(pPressed == false){
-                Polyline *pLine = new Polyline;
-                pLine->selected = true;
-                pLine->isPolyLine = true;
-                scene.addCurve(pLine);
+                editingCurve = scene.addCurve(POLYLINE_CURVE);
+                scene.select(editingCurve);
                 pPressed = true;
                 nonePressed = false;
             }
@@ -371,10 +621,8 @@ void onKeyboard(unsigned char key,int x, int y) {
         }
         case 'l':{
             if (lPressed == false) {
-                Largrange *lCurve = new Largrange;
-                lCurve->selected = true;
-                lCurve->isLagrange = true;
-                scene.addCurve(lCurve);
+                editingCurve = scene.addCurve(LAGRANGE_CURVE);
+                scene.select(editingCurve);
                 lPressed = true;
                 nonePressed = false;
             }
@@ -382,31 +630,35 @@ void onKeyboard(unsigned char key,int x, int y) {
         }
         case 'b':{
             if(bPressed == false){
-                BezierCurve *bCurve = new BezierCurve;
-                bCurve->selected = true;
-                scene.addCurve(bCurve);
+                editingCurve = scene.addCurve(BEZIER_CURVE);
+                scene.select(editingCurve);
                 bPressed = true;
                 nonePressed = false;
             }
             break;
         }
         case ' ':{
-            if(curves.size() > 0){
-                int indexSelected = indexCurveSelected();
-                if(indexSelected == -1){
-                    indexSelected++;
-                }
-                int nextIndex = indexSelected + 1;
-                if(nextIndex != curves.size()){
-                    curves.at(indexSelected)->selected = false;
-                    curves.at(nextIndex)->selected = true;
-                }
-                else{
-                    curves.at(0)->selected = true;
-                    curves.at(indexSelected)->selected = false;
-                }
-            }
-        
+            scene.selectNext();
+            break;
+        }
+        case 'n':{
+            showMarkers = !showMarkers;
+            break;
+        }
+        //hold m, r or s and drag to move, rotate or scale the selected curve and its group
+        case 'm':{
+            mPressed = true;
+            nonePressed = false;
+            break;
+        }
+        case 'r':{
+            rPressed = true;
+            nonePressed = false;
+            break;
+        }
+        case 's':{
+            sPressed = true;
+            nonePressed = false;
             break;
         }
         default:
@@ -415,21 +667,28 @@ void onKeyboard(unsigned char key,int x, int y) {
 }
 
 
-void checkIfEnoughPoints(){
-    for(int i=0; i<curves.size(); i++){
-        if (curves.at(i)->numControlPoints() < 2) {
-            curves.at(i)->deleteCPoint(0);
-            scene.deleteCurve(i);
-        }
+//only the curve that was just edited can have dropped below two points
+void checkIfEnoughPoints(CurveHandle h){
+    Freeform *curve = scene.getCurve(h);
+    if (curve != nullptr && curve->numControlPoints() < 2) {
+        scene.deleteCurve(h);
     }
     
 }
 
-void onKeyboardUp(unsigned char key, int x, int y) {
+//ends the curve being built: it loses the selection and is dropped if too short
+void finishEditingCurve(){
+    if(scene.isSelected(editingCurve))
+        scene.deselect();
+    checkIfEnoughPoints(editingCurve);
+    editingCurve = CurveHandle();
+}
+
+void editKeyboardUp(unsigned char key) {
     if (key == 'p') {
         pPressed = false;
         nonePressed = true;
-        curves.at(curves.size()-1)->selected = false;
+        finishEditingCurve();
     }
     if (key == 'a') {
         aPressed = false;
@@ -440,18 +699,22 @@ void onKeyboardUp(unsigned char key, int x, int y) {
         dPressed = false;
         nonePressed = true;
     }
+    if (key == 'm' || key == 'r' || key == 's') {
+        mPressed = rPressed = sPressed = false;
+        nonePressed = true;
+        transforming = false;
+    }
     
     if (key == 'l') {
         lPressed = false;
         nonePressed = true;
-        curves.at(curves.size()-1)->selected = false;
+        finishEditingCurve();
     }
     if (key == 'b') {
         bPressed = false;
         nonePressed = true;
-        curves.at(curves.size()-1)->selected = false;
+        finishEditingCurve();
     }
-    checkIfEnoughPoints();
 }
 
 
@@ -463,9 +726,10 @@ void onKeyboardUp(unsigned char key, int x, int y) {
 //if dot product is negative, then it's outside (two cases)
 Freeform *closestCurveForPoly(float2 click, Freeform *curve){
     Freeform *closest = nullptr;
-    for (int i=0; i<curve->getCPoints().size()-1; i++) {
-        float2 cp1 = curve->getCPoints().at(i);
-        float2 cp2 = curve->getCPoints().at(i+1);
+    const std::vector<float2>& cpoints = curve->getCPoints();
+    for (int i=0; i+1<cpoints.size(); i++) {
+        float2 cp1 = cpoints[i];
+        float2 cp2 = cpoints[i+1];
         
         float2 firstLine = click - cp1;
         
@@ -473,14 +737,12 @@ Freeform *closestCurveForPoly(float2 click, Freeform *curve){
         
         float2 tempSecondLine = secondLine;
         
-        secondLine.normalize();
+        secondLine = secondLine.normalized();
         
         float crossProduct = (firstLine.x * secondLine.y - firstLine.y * secondLine.x);
         
-        float dotProduct =  ((click.x - curve->getCPoints().at(i).x) *
-                             (curve->getCPoints().at(i+1).x - curve->getCPoints().at(i).x))
-                            + ((click.y - curve->getCPoints().at(i).y) *
-                            (curve->getCPoints().at(i+1).y - curve->getCPoints().at(i).y));
+        float dotProduct =  ((click.x - cp1.x) * (cp2.x - cp1.x))
+                            + ((click.y - cp1.y) * (cp2.y - cp1.y));
         
         
         if((fabs(crossProduct) < 0.05f) && (dotProduct > 0.0f)){
@@ -496,28 +758,36 @@ Freeform *closestCurveForPoly(float2 click, Freeform *curve){
     return closest;
 }
 
-Freeform *closestCurveToMouse(float2 click){
-    Freeform *closest = nullptr;
-    for (int i=0; i<curves.size(); i++) {
-        if(closest != nullptr){
-            break;
-        }
-        if(curves.at(i)->isPolyLine){
-            closest = closestCurveForPoly(click, curves.at(i));
-            if(closest != nullptr){
+CurveHandle closestCurveToMouse(float2 click){
+    CurveHandle closest;
+    //every smooth curve is sampled at the same parameters, in one batch per curve
+    const int samples = 100;
+    float *ts = eventArena.allocate<float>(samples);
+    float2 *points = eventArena.allocate<float2>(samples);
+    for(int j=0; j<samples; j++)
+        ts[j] = j / float(samples);
+    for (int i=0; i<scene.numCurves(); i++) {
+        Freeform *curve = scene.curveAt(i);
+        if(curve->type == POLYLINE_CURVE){
+            if(closestCurveForPoly(click, curve) != nullptr){
+                closest = scene.handleAt(i);
                 break;
             }
             
         }
         else{
-            for(float p=0; p < 1; p+=.01 ){
-                if(((fabs(click.x - curves.at(i)->getPoint(p).x)) < 0.09f) &&
-                   ((fabs(click.y - curves.at(i)->getPoint(p).y)) < 0.09f))
+            curve->getPoints(ts, points, samples);
+            for(int j=0; j<samples; j++){
+                if(((fabs(click.x - points[j].x)) < 0.09f) &&
+                   ((fabs(click.y - points[j].y)) < 0.09f))
                 {
-                    closest = curves.at(i);
+                    closest = scene.handleAt(i);
                     break;
                 }
             }
+            if(scene.getCurve(closest) != nullptr){
+                break;
+            }
 
         }
     }
@@ -527,13 +797,15 @@ Freeform *closestCurveToMouse(float2 click){
 
 
 
-float2 *closestControlPoint(float2 click){
-    float2 *closest = nullptr;
-    Freeform *curve = closestCurveToMouse(click);
+//points into the curve, so it is good until the curve is next edited
+const float2 *closestControlPoint(float2 click){
+    const float2 *closest = nullptr;
+    Freeform *curve = scene.getCurve(closestCurveToMouse(click));
     if(curve != nullptr){
-        for(int i=0; i<curve->numControlPoints(); i++){
-            if((fabs(click.x - curve->getCPoints().at(i).x) < 0.09f) && (fabs(click.y - curve->getCPoints().at(i).y) < 0.09f)){
-                closest = &curve->getCPoints().at(i);
+        const std::vector<float2>& cpoints = curve->getCPoints();
+        for(int i=0; i<cpoints.size(); i++){
+            if((fabs(click.x - cpoints[i].x) < 0.09f) && (fabs(click.y - cpoints[i].y) < 0.09f)){
+                closest = &cpoints[i];
             }
         }
         
@@ -545,6 +817,59 @@ float2 *closestControlPoint(float2 click){
 
 
 
+//the control point of the clicked curve under the mouse, if any, follows later moves
+void beginPointDrag(CurveHandle h, float2 click){
+    dragPoint = -1;
+    Freeform *curve = scene.getCurve(h);
+    if(curve == nullptr)
+        return;
+    const std::vector<float2>& cpoints = curve->getCPoints();
+    for(int i=0; i<cpoints.size(); i++){
+        if((fabs(click.x - cpoints.at(i).x) < 0.09f) && (fabs(click.y - cpoints.at(i).y) < 0.09f)){
+            dragCurve = h;
+            dragPoint = i;
+            break;
+        }
+    }
+}
+
+
+//pivot for rotate and scale is the centroid of all affected control points
+void beginTransform(float2 click){
+    scene.transformTargets(transformTargets);
+    transformStartPoints.clear();
+    transformStartCounts.clear();
+    for(unsigned int i=0; i<transformTargets.size(); i++){
+        const std::vector<float2>& cpoints = scene.getCurve(transformTargets[i])->getCPoints();
+        transformStartPoints.insert(transformStartPoints.end(), cpoints.begin(), cpoints.end());
+        transformStartCounts.push_back(cpoints.size());
+    }
+    if(transformStartPoints.empty())
+        return;
+    float2 sum;
+    for(unsigned int i=0; i<transformStartPoints.size(); i++)
+        sum += transformStartPoints[i];
+    transformPivot = sum * (1.0f / transformStartPoints.size());
+    transformStart = click;
+    transforming = true;
+}
+
+
+//the transform that takes the drag start position to the current one
+affine2<float> dragTransform(float2 from, float2 to){
+    if(mPressed)
+        return affine2<float>::translation(to - from);
+    float2 a = from - transformPivot;
+    float2 b = to - transformPivot;
+    if(rPressed)
+        return affine2<float>::rotation(atan2f(b.y, b.x) - atan2f(a.y, a.x), transformPivot);
+    if(a.norm2() < 1e-8f)
+        return affine2<float>();
+    float ratio = b.norm() / a.norm();
+    return affine2<float>::scaling(float2(ratio, ratio), transformPivot);
+}
+
+
 //onMove --> callback function called whenever move the mouse
 //if MOUSE/key is pressed, then drag and drop
 //when click mouse, you register that position --> determie the difference vector betweeen the click, and the current mouse, and add that
@@ -552,69 +877,61 @@ float2 *closestControlPoint(float2 click){
 //be sure to call postdispley in move function, to ensure smooth move
 //calculate difference vector --> add the difference vector to the control point
 
-void onMouse(int button, int state, int x, int y) {
-    int viewportRect[4];
-    glGetIntegerv(GL_VIEWPORT, viewportRect);
-    
-//    int clickX = x * 2.0 / viewportRect[2] - 1.0;
-//    int clickY = -y * 2.0 / viewportRect[3] + 1.0;
-//    
-//    
+void editMouse(int button, int state, float2 click, bool shift) {
+    if(button == GLUT_LEFT_BUTTON && state == GLUT_UP){
+        transforming = false;
+        dragPoint = -1;
+    }
     if(!nonePressed){
+        if(mPressed || rPressed || sPressed){
+            if(button == GLUT_LEFT_BUTTON && state == GLUT_DOWN){
+                beginTransform(click);
+            }
+        }
         if (pPressed) {
-            if (button == GLUT_LEFT_BUTTON && state == GLUT_DOWN)
-                curves.at(curves.size()-1)->addControlPoint(float2(x * 2.0 / viewportRect[2] - 1.0,
-                                                                   -y * 2.0 / viewportRect[3] + 1.0));
+            if (button == GLUT_LEFT_BUTTON && state == GLUT_DOWN && scene.getCurve(editingCurve) != nullptr)
+                scene.getCurve(editingCurve)->addControlPoint(click);
         }
         if(dPressed){
-            if(button == GLUT_LEFT_BUTTON && state == GLUT_DOWN && curves.size()>0){
-                float2 *closestCPoint = closestControlPoint(float2(
-                                                                   x * 2.0 / viewportRect[2] - 1.0,
-                                                                   -y * 2.0 / viewportRect[3] + 1.0));
+            if(button == GLUT_LEFT_BUTTON && state == GLUT_DOWN && scene.numCurves()>0){
+                const float2 *closestCPoint = closestControlPoint(click);
                 
-                Freeform *closestCurve = closestCurveToMouse((float2(
-                                                                     x * 2.0 / viewportRect[2] - 1.0,
-                                                                     -y * 2.0 / viewportRect[3] + 1.0)));
+                CurveHandle closestHandle = closestCurveToMouse(click);
+                Freeform *closestCurve = scene.getCurve(closestHandle);
                 if(closestCPoint != nullptr && closestCurve != nullptr){
-                    for(int i=0; i<closestCurve->getCPoints().size(); i++){
-                        if((closestCurve->getCPoints().at(i).x == closestCPoint->x) &&
-                           (closestCurve->getCPoints().at(i).y == closestCPoint->y)){
+                    const std::vector<float2>& cpoints = closestCurve->getCPoints();
+                    for(int i=0; i<cpoints.size(); i++){
+                        if(&cpoints[i] == closestCPoint){
                             closestCurve->deleteCPoint(i);
-                            if(closestCurve->isLagrange){
+                            if(closestCurve->type == LAGRANGE_CURVE){
                                 Largrange *lcurve = (Largrange*) closestCurve;
                                 lcurve->eraseCP();
                             }
                             break;
                         }
                     }
-                    checkIfEnoughPoints();
+                    checkIfEnoughPoints(closestHandle);
                 }
             }
         }
         if(lPressed){
-            if (button == GLUT_LEFT_BUTTON && state == GLUT_DOWN){
-                curves.at(curves.size()-1)->addControlPoint( float2(
-                                                                    x * 2.0 / viewportRect[2] - 1.0,
-                                                                    -y * 2.0 / viewportRect[3] + 1.0));
+            if (button == GLUT_LEFT_BUTTON && state == GLUT_DOWN && scene.getCurve(editingCurve) != nullptr){
+                scene.getCurve(editingCurve)->addControlPoint(click);
                 
             }
             
         }
         
         if(bPressed){
-            if (button == GLUT_LEFT_BUTTON && state == GLUT_DOWN){
-                curves.at(curves.size()-1)->addControlPoint( float2(
-                                                                    x * 2.0 / viewportRect[2] - 1.0,
-                                                                    -y * 2.0 / viewportRect[3] + 1.0));
+            if (button == GLUT_LEFT_BUTTON && state == GLUT_DOWN && scene.getCurve(editingCurve) != nullptr){
+                scene.getCurve(editingCurve)->addControlPoint(click);
                 
             }
         }
         if(aPressed){
             if (button == GLUT_LEFT_BUTTON && state == GLUT_DOWN){
-                if(indexCurveSelected() != -1)
-                    curves.at(indexCurveSelected())->addControlPoint( float2(
-                                                                             x * 2.0 / viewportRect[2] - 1.0,
-                                                                             -y * 2.0 / viewportRect[3] + 1.0));
+                if(scene.selectedCurve() != nullptr)
+                    scene.selectedCurve()->addControlPoint(click);
                 
             }
             
@@ -622,77 +939,406 @@ void onMouse(int button, int state, int x, int y) {
         }
         
     }else
-        if(button == GLUT_LEFT_BUTTON && state == GLUT_DOWN && curves.size()>0){
-                Freeform *closest = closestCurveToMouse(float2(
-                                                               x * 2.0 / viewportRect[2] - 1.0,
-                                                               -y * 2.0 / viewportRect[3] + 1.0));
-                deselectPreviouslySelected();
-                if(closest != nullptr)
-                    closest->selected = true;
+        if(button == GLUT_LEFT_BUTTON && state == GLUT_DOWN && scene.numCurves()>0){
+                //control points of the selected curve come first: a Bezier's
+                //mostly lie off the curve, where the curve hit test misses them
+                if(!shift){
+                    beginPointDrag(scene.selectedHandle(), click);
+                    if(dragPoint != -1)
+                        return;
+                }
+                CurveHandle closest = closestCurveToMouse(click);
+                if(shift){
+                    scene.toggleGroup(closest);
+                    return;
+                }
+                //a miss yields an invalid handle, which clears the selection
+                scene.select(closest);
+                scene.clearGroup();
+                beginPointDrag(closest, click);
             }
+}
+
+void editMove(float2 click){
+    if(transforming){
+        affine2<float> m = dragTransform(transformStart, click);
+        const float2 *start = transformStartPoints.data();
+        for(unsigned int i=0; i<transformTargets.size(); i++){
+            Freeform *curve = scene.getCurve(transformTargets[i]);
+            //curves deleted or given new points since the drag started are left alone
+            if(curve != nullptr && curve->numControlPoints() == transformStartCounts[i])
+                curve->transformFrom(start, m);
+            start += transformStartCounts[i];
+        }
+        return;
+    }
     
+    Freeform *curve = scene.getCurve(dragCurve);
+    if(curve != nullptr && dragPoint != -1 && dragPoint < curve->numControlPoints()){
+        curve->moveCPoint(dragPoint, click);
+    }
+}
+
+
+//GLUT input is queued and applied on the edit thread, so hit tests and
+//edits never hold up a frame and a slow frame never holds up input
+class InputEvent
+{
+public:
+    enum Kind { KEY_DOWN, KEY_UP, MOUSE, MOVE } kind;
+    unsigned char key;
+    int button;
+    int state;
+    bool shift;
+    float2 position;
+};
+
+std::mutex inputMutex;
+std::condition_variable inputReady;
+//swapped with the edit thread's batch, so both keep their capacity
+std::vector<InputEvent> inputQueue;
+//set under inputMutex when the process exits; the edit thread finishes its batch and returns
+bool editThreadStopping = false;
+std::thread editThread;
+
+void postInput(const InputEvent& event){
+    {
+        std::lock_guard<std::mutex> lock(inputMutex);
+        inputQueue.push_back(event);
+    }
+    inputReady.notify_one();
+}
+
+void applyInput(const InputEvent& event){
+    eventArena.reset();
+    switch (event.kind) {
+        case InputEvent::KEY_DOWN:
+            editKeyboard(event.key);
+            break;
+        case InputEvent::KEY_UP:
+            editKeyboardUp(event.key);
+            break;
+        case InputEvent::MOUSE:
+            editMouse(event.button, event.state, event.position, event.shift);
+            break;
+        case InputEvent::MOVE:
+            editMove(event.position);
+            break;
+    }
+}
+
+//refills the snapshot onDisplay handed back, if there is one
+void publishSnapshot(){
+    eventArena.reset();
+    SceneSnapshot *next = recycledSnapshot.take();
+    if(next == nullptr)
+        next = new SceneSnapshot;
+    scene.snapshot(next);
+    publishedSnapshot.publish(next);
+}
+
+//drains whatever input has queued up, then publishes one snapshot for the batch
+void editLoop(){
+    std::vector<InputEvent> batch;
+    for(;;){
+        {
+            std::unique_lock<std::mutex> lock(inputMutex);
+            while(inputQueue.empty() && !editThreadStopping)
+                inputReady.wait(lock);
+            if(editThreadStopping)
+                return;
+            batch.swap(inputQueue);
+        }
+        for(unsigned int i=0; i<batch.size(); i++)
+            applyInput(batch[i]);
+        batch.clear();
+        publishSnapshot();
+    }
+}
+
+//GLUT leaves its main loop through exit(); registered after the globals are
+//built, this runs before their destructors, so the thread is gone by then
+void stopEditThread(){
+    {
+        std::lock_guard<std::mutex> lock(inputMutex);
+        editThreadStopping = true;
+    }
+    inputReady.notify_one();
+    if(editThread.joinable())
+        editThread.join();
+}
+
+//window coordinates to normalized device coordinates
+float2 toScene(int x, int y){
+    int viewportRect[4];
+    glGetIntegerv(GL_VIEWPORT, viewportRect);
+    return float2(x * 2.0 / viewportRect[2] - 1.0,
+                  -y * 2.0 / viewportRect[3] + 1.0);
+}
+
+void onKeyboard(unsigned char key, int x, int y) {
+    InputEvent event;
+    event.kind = InputEvent::KEY_DOWN;
+    event.key = key;
+    postInput(event);
+}
+
+void onKeyboardUp(unsigned char key, int x, int y) {
+    InputEvent event;
+    event.kind = InputEvent::KEY_UP;
+    event.key = key;
+    postInput(event);
+}
+
+void onMouse(int button, int state, int x, int y) {
+    InputEvent event;
+    event.kind = InputEvent::MOUSE;
+    event.button = button;
+    event.state = state;
+    event.shift = (glutGetModifiers() & GLUT_ACTIVE_SHIFT) != 0;
+    event.position = toScene(x, y);
+    postInput(event);
+}
+
+void onMove(int x, int y){
+    InputEvent event;
+    event.kind = InputEvent::MOVE;
+    event.position = toScene(x, y);
+    postInput(event);
+}
+
+
+void onIdle() {
+    t = glutGet(GLUT_ELAPSED_TIME) / 1000.0f;
     glutPostRedisplay();
 }
 
-void movePoint(int mouseX, int mouseY, int index, Freeform *curve){
-    curve->getCPoints().at(index).x = mouseX;
-    curve->getCPoints().at(index).y = mouseY;
+
+
+
+//--------------------------------------------------------
+// Headless timings: CurvesEditor --bench
+//--------------------------------------------------------
+double millisecondsSince(std::chrono::steady_clock::time_point start){
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+//one set that stays in L1 and one far larger than the caches, so the kernel
+//and the memory bandwidth are measured separately
+void benchTransform(){
+    const int sizes[] = {4096, 1 << 22};
+    for(int k=0; k<2; k++){
+        int numPoints = sizes[k];
+        //about 2^28 points transformed per size
+        int passes = (1 << 28) / numPoints;
+        Polyline curve;
+        for(int i=0; i<numPoints; i++)
+            curve.addControlPoint(float2::random());
+        affine2<float> m = affine2<float>::rotation(0.001f, float2(0.1f, 0.2f)) *
+                           affine2<float>::scaling(float2(1.0001f, 0.9999f), float2());
+        
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for(int i=0; i<passes; i++)
+            curve.transform(m);
+        double ms = millisecondsSince(start);
+        printf("transform: %d points x %d passes, %.2f Mpoints/ms\n",
+               numPoints, passes, numPoints * (double)passes / ms / 1e6);
+    }
+}
+
+void benchArcLength(){
+    const int queries = 1 << 20;
+    BezierCurve curve;
+    for(int i=0; i<8; i++)
+        curve.addControlPoint(float2::random());
+    const ArcLengthTable<float>& table = curve.arcLengthTable();
+    float length = table.totalLength();
     
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    float sum = 0;
+    for(int i=0; i<queries; i++)
+        sum += table.parameterAt(length * i / queries);
+    double ms = millisecondsSince(start);
+    printf("arc length lookup: %d queries, %.1f ns/query (checksum %g)\n",
+           queries, ms * 1e6 / queries, sum);
+}
+
+void benchStroke(){
+    const int meshes = 2000;
+    BezierCurve curve;
+    for(int i=0; i<8; i++)
+        curve.addControlPoint(float2::random());
+    std::vector<float2> strip;
+    curve.tessellate(strip);
+    std::vector<float2> mesh;
+    std::vector<float2> scratch(strip.size());
     
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for(int i=0; i<meshes; i++){
+        mesh.clear();
+        strokeInPixels(&strip[0], strip.size(), thickStrokeWidth, ROUND_JOIN, 640, 480, &scratch[0], mesh);
+    }
+    double ms = millisecondsSince(start);
+    printf("stroke mesh: %d-point strip -> %d triangles, %.1f us/mesh\n",
+           (int)strip.size(), (int)mesh.size() / 3, ms * 1e3 / meshes);
 }
 
+void runBenchmarks(){
+    benchTransform();
+    benchArcLength();
+    benchStroke();
+}
 
-void onMove(int x, int y){
+
+//--------------------------------------------------------
+// Headless allocation check: CurvesEditor --audit-allocations
+// Builds a scene through the same input path as the window, warms every
+// cache up once, then counts heap allocations over steady-state frames,
+// hit tests, selection clicks and control point drags. All four must be
+// zero. A drag counts the edit and the arc length rebuild it triggers; the
+// render copy of the edited curve is rebuilt from scratch on every publish
+// and still allocates, which is reported but not checked.
+//--------------------------------------------------------
+InputEvent keyEvent(InputEvent::Kind kind, unsigned char key){
+    InputEvent event;
+    event.kind = kind;
+    event.key = key;
+    return event;
+}
+
+InputEvent mouseEvent(int state, float2 position){
+    InputEvent event;
+    event.kind = InputEvent::MOUSE;
+    event.button = GLUT_LEFT_BUTTON;
+    event.state = state;
+    event.shift = false;
+    event.position = position;
+    return event;
+}
+
+//a click at the first control point of every curve in turn, as the GLUT thread would post it
+void clickEveryCurve(){
+    for(int i=0; i<scene.numCurves(); i++){
+        float2 at = scene.curveAt(i)->getCPoints()[0];
+        applyInput(mouseEvent(GLUT_DOWN, at));
+        applyInput(mouseEvent(GLUT_UP, at));
+        publishSnapshot();
+        FramePlan frame;
+        prepareFrame(frame);
+    }
+}
+
+int runAllocationAudit(){
+    if(!allocationAuditEnabled()){
+        printf("allocation audit: not counting; build the Audit configuration (CURVES_ALLOCATION_AUDIT)\n");
+        return 1;
+    }
+    const int frames = 1000;
+    const int hitTests = 1000;
+    const int clickRounds = 100;
+    const int drags = 1000;
     
+    const unsigned char curveKeys[] = {'p', 'b', 'l'};
+    for(int k=0; k<3; k++){
+        applyInput(keyEvent(InputEvent::KEY_DOWN, curveKeys[k]));
+        for(int i=0; i<8; i++){
+            float2 at = float2::random() * 0.9f;
+            applyInput(mouseEvent(GLUT_DOWN, at));
+            applyInput(mouseEvent(GLUT_UP, at));
+        }
+        applyInput(keyEvent(InputEvent::KEY_UP, curveKeys[k]));
+    }
+    applyInput(keyEvent(InputEvent::KEY_DOWN, 'n'));
+    applyInput(keyEvent(InputEvent::KEY_UP, 'n'));
+    publishSnapshot();
     
-    int viewportRect[4];
-    glGetIntegerv(GL_VIEWPORT, viewportRect);
+    //first use builds the meshes and sizes the arenas and snapshot vectors
+    for(int i=0; i<3; i++)
+        clickEveryCurve();
     
-    float mouseX = x * 2.0 / viewportRect[2] - 1.0;
-    float mouseY = -y * 2.0 / viewportRect[3] + 1.0;
+    unsigned long long start = allocationCount();
+    for(int i=0; i<frames; i++){
+        t = i / 60.0f;
+        FramePlan frame;
+        prepareFrame(frame);
+    }
+    unsigned long long frameAllocations = allocationCount() - start;
     
-    float2 click = float2(mouseX, mouseY);
-    int index = -1;
+    start = allocationCount();
+    int hits = 0;
+    for(int i=0; i<hitTests; i++){
+        eventArena.reset();
+        float2 at = scene.curveAt(i % scene.numCurves())->getCPoints()[0];
+        hits += scene.getCurve(closestCurveToMouse(at)) != nullptr;
+        hits += closestControlPoint(at) != nullptr;
+    }
+    unsigned long long hitAllocations = allocationCount() - start;
     
-    Freeform *curve = closestCurveToMouse(click);
+    start = allocationCount();
+    for(int i=0; i<clickRounds; i++)
+        clickEveryCurve();
+    unsigned long long clickAllocations = allocationCount() - start;
     
-    if(curve != nullptr){
-        for(int i=0; i<curve->numControlPoints(); i++){
-            if((fabs(click.x - curve->getCPoints().at(i).x) < 0.09f) && (fabs(click.y - curve->getCPoints().at(i).y) < 0.09f)){
-                
-                index = i;
-                break;
-            }
-        }
+    //press on a control point of the selected curve and wiggle it
+    Freeform *dragged = scene.curveAt(0);
+    scene.select(scene.handleAt(0));
+    float2 grabbed = dragged->getCPoints()[1];
+    applyInput(mouseEvent(GLUT_DOWN, grabbed));
+    InputEvent move;
+    move.kind = InputEvent::MOVE;
+    move.position = grabbed;
+    applyInput(move);
+    dragged->arcLengthTable();
+    start = allocationCount();
+    for(int i=0; i<drags; i++){
+        move.position = grabbed + float2(0.01f * (i % 7), -0.01f * (i % 5));
+        applyInput(move);
+        dragged->arcLengthTable();
     }
+    unsigned long long dragAllocations = allocationCount() - start;
     
-    if(index != -1){
-//        movePoint(mouseX, mouseY, index, curve);
-        
-        curve->getCPoints().at(index).x = mouseX;
-        curve->getCPoints().at(index).y = mouseX;
-//        printf("%s %f %f \n", "x and y after move:", curve->getCPoints().at(index).x, curve->getCPoints().at(index).y);
-//        printf("%s %f %f \n", "mouse x and y:", mouseX, mouseY);
-        
+    //the first few fill the render copy pool: one for the scene, one published, one drawn
+    for(int pass=0; pass<2; pass++){
+        start = allocationCount();
+        for(int i=0; i<clickRounds; i++){
+            move.position = grabbed + float2(0.01f * (i % 7), 0);
+            applyInput(move);
+            publishSnapshot();
+            FramePlan frame;
+            prepareFrame(frame);
+        }
     }
+    unsigned long long redrawAllocations = allocationCount() - start;
+    applyInput(mouseEvent(GLUT_UP, move.position));
     
-    glutPostRedisplay();
-
-    
+    printf("frames: %d, %llu allocations\n", frames, frameAllocations);
+    printf("hit tests: %d (%d hits), %llu allocations\n", hitTests, hits, hitAllocations);
+    printf("selection clicks: %d, %llu allocations\n", clickRounds * scene.numCurves(), clickAllocations);
+    printf("drags: %d, %llu allocations\n", drags, dragAllocations);
+    printf("drags with redraw: %d, %llu allocations\n", clickRounds, redrawAllocations);
+    return frameAllocations == 0 && hitAllocations == 0 && clickAllocations == 0 && dragAllocations == 0 &&
+           redrawAllocations == 0 ? 0 : 1;
 }
 
 
-void onIdle() {
-    glutPostRedisplay();
-}
-
-
-
-
 //--------------------------------------------------------
 // The entry point of the application
 //--------------------------------------------------------
 int main(int argc, char *argv[]) {
+    if(argc > 1 && strcmp(argv[1], "--bench") == 0){
+        runBenchmarks();
+        return 0;
+    }
+    if(argc > 1 && strcmp(argv[1], "--serve") == 0){
+        return runService(argc > 2 ? argv[2] : nullptr);
+    }
+    if(argc > 1 && strcmp(argv[1], "--audit-allocations") == 0){
+        return runAllocationAudit();
+    }
+    if(argc > 2 && strcmp(argv[1], "--loadgen") == 0){
+        return runLoadGenerator(argv[2], argc > 3 ? atof(argv[3]) : 5.0);
+    }
+    
     glutInit(&argc, argv);                 // GLUT initialization
     glutInitWindowSize(640, 480); // Initial resolution of the MsWindows Window is 600x600 pixels
     glutInitWindowPosition(100, 100);            // Initial location of the MsWindows window
@@ -707,6 +1353,9 @@ int main(int argc, char *argv[]) {
     glutMouseFunc(onMouse);
     glutMotionFunc(onMove);
     
+    editThread = std::thread(editLoop);
+    atexit(stopEditThread);
+    
     
     
     
@@ -0,0 +1,564 @@
+//
+//  service.cpp
+//  CurvesEditor
+//
+//  See service.h for the wire format.
+//
+
+#include "service.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "curves.h"
+
+//the service evaluates in double; high-degree Lagrange curves need it
+typedef FreeformT<double> ServiceCurve;
+
+
+static bool readFully(int fd, void *buffer, size_t size){
+    char *p = (char*)buffer;
+    while(size > 0){
+        ssize_t n = read(fd, p, size);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+static bool writeFully(int fd, const void *buffer, size_t size){
+    const char *p = (const char*)buffer;
+    while(size > 0){
+        ssize_t n = write(fd, p, size);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+
+//curves are reused for requests with the same control points, and with them
+//the basis data they prepare on first use (see curves.h). Each worker keeps
+//its own cache, so a lookup takes no lock; the price is that a curve is
+//prepared once per worker that sees it.
+class PreparedCurveCache
+{
+    struct Entry {
+        uint32_t type;
+        std::vector<float> coords;
+        std::shared_ptr<ServiceCurve> curve;
+    };
+
+    std::unordered_map<uint64_t, Entry> entries;
+    //dropped wholesale when reached; the working set of a pipeline is small
+    const size_t capacity = 1024;
+
+    static uint64_t hash(uint32_t type, const float *coords, int count){
+        //FNV-1a over 32-bit words
+        uint64_t h = (14695981039346656037ull ^ type) * 1099511628211ull;
+        for(int i=0; i<count; i++){
+            uint32_t word;
+            memcpy(&word, &coords[i], sizeof(word));
+            h = (h ^ word) * 1099511628211ull;
+        }
+        return h;
+    }
+
+    static std::shared_ptr<ServiceCurve> build(uint32_t type, const float *coords, int numPoints){
+        std::shared_ptr<ServiceCurve> curve;
+        switch (type) {
+            case POLYLINE_CURVE:
+                curve = std::make_shared<PolylineT<double> >();
+                break;
+            case LAGRANGE_CURVE:
+                curve = std::make_shared<LargrangeT<double> >();
+                break;
+            default:
+                curve = std::make_shared<BezierCurveT<double> >();
+                break;
+        }
+        for(int i=0; i<numPoints; i++)
+            curve->addControlPoint(double2(coords[2*i], coords[2*i+1]));
+        //the first evaluation prepares the basis (barycentric weights, scaled
+        //points); doing it here keeps it out of every later request
+        curve->getPoint(0);
+        return curve;
+    }
+
+public:
+    //hit is set when the curve was already prepared
+    ServiceCurve *get(uint32_t type, const float *coords, int numPoints, bool& hit){
+        uint64_t key = hash(type, coords, numPoints * 2);
+        std::unordered_map<uint64_t, Entry>::iterator found = entries.find(key);
+        hit = found != entries.end() && found->second.type == type &&
+              found->second.coords.size() == (size_t)numPoints * 2 &&
+              memcmp(&found->second.coords[0], coords, numPoints * 2 * sizeof(float)) == 0;
+        if(hit)
+            return found->second.curve.get();
+        if(entries.size() >= capacity)
+            entries.clear();
+        Entry& entry = entries[key];
+        entry.type = type;
+        entry.coords.assign(coords, coords + numPoints * 2);
+        entry.curve = build(type, coords, numPoints);
+        return entry.curve.get();
+    }
+};
+
+
+//requests of one client read but not yet answered, and the bytes they hold
+//(request payloads, then the responses waiting to be written). Past either
+//the reader stops reading, so a client that writes faster than it reads
+//blocks on its own socket instead of growing the server.
+const int maxPendingRequests = 256;
+const size_t maxPendingBytes = 32 << 20;
+//clients served at once; more wait in the listen backlog
+const int maxConnections = 32;
+
+//one client. Workers hand finished responses to its writer thread, which is
+//the only one to block on the client's socket, so a client that stops
+//reading stalls nothing but itself.
+class Connection
+{
+    struct Outgoing {
+        ServiceResponse header;
+        std::vector<float> coords;
+    };
+
+    std::mutex mutex;
+    //signalled when a response is queued, written, or the connection closes
+    std::condition_variable changed;
+    std::deque<Outgoing> outbox;
+    int pending;
+    size_t pendingBytes;
+    bool closing;
+    std::thread writer;
+
+    static size_t bytesOf(const Outgoing& outgoing){
+        return sizeof(outgoing.header) + outgoing.coords.size() * sizeof(float);
+    }
+
+    void writeLoop(){
+        //once the client has gone the rest is dropped, but still counted out
+        bool broken = false;
+        std::unique_lock<std::mutex> lock(mutex);
+        for(;;){
+            while(outbox.empty() && !closing)
+                changed.wait(lock);
+            if(outbox.empty())
+                return;
+            Outgoing outgoing;
+            std::swap(outgoing, outbox.front());
+            outbox.pop_front();
+            lock.unlock();
+            if(!broken)
+                broken = !writeFully(out, &outgoing.header, sizeof(outgoing.header)) ||
+                         (!outgoing.coords.empty() &&
+                          !writeFully(out, &outgoing.coords[0], outgoing.coords.size() * sizeof(float)));
+            lock.lock();
+            pending--;
+            pendingBytes -= bytesOf(outgoing);
+            changed.notify_all();
+        }
+    }
+
+public:
+    int in;
+    int out;
+
+    Connection(int in, int out):pending(0),pendingBytes(0),closing(false),in(in),out(out){
+        writer = std::thread(&Connection::writeLoop, this);
+    }
+
+    ~Connection(){
+        close();
+    }
+
+    //charges a request of bytes to the connection, waiting while it is over either limit
+    void reserve(size_t bytes){
+        std::unique_lock<std::mutex> lock(mutex);
+        while(pending >= maxPendingRequests || (pending > 0 && pendingBytes + bytes > maxPendingBytes))
+            changed.wait(lock);
+        pending++;
+        pendingBytes += bytes;
+    }
+
+    //queues the response to a reserved request; the bytes reserve() charged are
+    //traded for the response's. Never blocks on the socket. coords is taken.
+    void respond(const ServiceResponse& header, std::vector<float>& coords, size_t requestBytes){
+        Outgoing outgoing;
+        outgoing.header = header;
+        outgoing.coords.swap(coords);
+        std::lock_guard<std::mutex> lock(mutex);
+        pendingBytes += bytesOf(outgoing);
+        pendingBytes -= requestBytes;
+        outbox.push_back(Outgoing());
+        std::swap(outbox.back(), outgoing);
+        changed.notify_all();
+    }
+
+    //gives back a reservation that will never be answered
+    void cancel(size_t bytes){
+        std::lock_guard<std::mutex> lock(mutex);
+        pending--;
+        pendingBytes -= bytes;
+        changed.notify_all();
+    }
+
+    //waits until every response has been written, then stops the writer
+    void close(){
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            while(pending > 0)
+                changed.wait(lock);
+            closing = true;
+            changed.notify_all();
+        }
+        if(writer.joinable())
+            writer.join();
+    }
+};
+
+
+class Job
+{
+public:
+    std::shared_ptr<Connection> connection;
+    ServiceRequest request;
+    //control points followed by parameters
+    std::vector<float> payload;
+
+    //what the job holds of its connection's byte budget
+    size_t bytes() const {
+        return sizeof(request) + payload.size() * sizeof(float);
+    }
+};
+
+
+class Service
+{
+    std::mutex queueMutex;
+    std::condition_variable queueReady;
+    std::deque<Job*> queue;
+    std::vector<std::thread> workers;
+
+public:
+    std::atomic<uint64_t> requests;
+    std::atomic<uint64_t> samples;
+    std::atomic<uint64_t> cacheHits;
+    std::atomic<uint64_t> cacheMisses;
+
+    Service():requests(0),samples(0),cacheHits(0),cacheMisses(0){
+        unsigned int count = std::thread::hardware_concurrency();
+        if(count == 0)
+            count = 4;
+        for(unsigned int i=0; i<count; i++)
+            workers.push_back(std::thread(&Service::workerLoop, this));
+        for(unsigned int i=0; i<workers.size(); i++)
+            workers[i].detach();
+    }
+
+    void submit(Job *job){
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            queue.push_back(job);
+        }
+        queueReady.notify_one();
+    }
+
+    //reads requests until the client hangs up or sends something unparseable
+    void readLoop(std::shared_ptr<Connection> connection){
+        for(;;){
+            Job *job = new Job;
+            job->connection = connection;
+            if(!readFully(connection->in, &job->request, sizeof(job->request))){
+                delete job;
+                break;
+            }
+            const ServiceRequest& request = job->request;
+            bool framed = request.numControlPoints <= maxServiceControlPoints && request.numParams <= maxServiceParams;
+            size_t count = 0;
+            if(framed){
+                count = request.numControlPoints * 2;
+                if(request.mode == EVALUATE_PARAMS)
+                    count += request.numParams;
+            }
+            //before the payload is read, so a stalled client stops being read
+            connection->reserve(sizeof(request) + count * sizeof(float));
+            if(!framed){
+                //the rest of the stream cannot be framed any more
+                ServiceResponse response = { request.id, SERVICE_BAD_REQUEST, 0 };
+                std::vector<float> none;
+                connection->respond(response, none, sizeof(request));
+                delete job;
+                break;
+            }
+            job->payload.resize(count);
+            if(count > 0 && !readFully(connection->in, &job->payload[0], count * sizeof(float))){
+                connection->cancel(job->bytes());
+                delete job;
+                break;
+            }
+            submit(job);
+        }
+        connection->close();
+    }
+
+    void printStats(){
+        fprintf(stderr, "served %llu requests, %llu samples; prepared curve cache %llu hits, %llu misses\n",
+                (unsigned long long)requests, (unsigned long long)samples,
+                (unsigned long long)cacheHits, (unsigned long long)cacheMisses);
+    }
+
+private:
+    void workerLoop(){
+        std::vector<double> params;
+        std::vector<double2> points;
+        std::vector<float> coords;
+        PreparedCurveCache cache;
+        for(;;){
+            Job *job;
+            {
+                std::unique_lock<std::mutex> lock(queueMutex);
+                while(queue.empty())
+                    queueReady.wait(lock);
+                job = queue.front();
+                queue.pop_front();
+            }
+            ServiceResponse response = { job->request.id, SERVICE_OK, 0 };
+            if(!evaluate(*job, cache, params, points)){
+                response.status = SERVICE_BAD_REQUEST;
+                points.clear();
+            }
+            coords.resize(points.size() * 2);
+            for(unsigned int i=0; i<points.size(); i++){
+                coords[2*i] = points[i].x;
+                coords[2*i+1] = points[i].y;
+            }
+            response.numPoints = points.size();
+            requests++;
+            samples += points.size();
+            job->connection->respond(response, coords, job->bytes());
+            delete job;
+        }
+    }
+
+    bool evaluate(const Job& job, PreparedCurveCache& cache, std::vector<double>& params, std::vector<double2>& points){
+        const ServiceRequest& request = job.request;
+        points.clear();
+        if(request.curveType >= CURVE_TYPE_COUNT || request.numControlPoints == 0)
+            return false;
+        bool hit;
+        ServiceCurve *curve = cache.get(request.curveType, job.payload.data(), request.numControlPoints, hit);
+        if(hit)
+            cacheHits++;
+        else
+            cacheMisses++;
+        switch (request.mode) {
+            case EVALUATE_PARAMS:{
+                const float *ts = job.payload.data() + request.numControlPoints * 2;
+                params.assign(ts, ts + request.numParams);
+                points.resize(request.numParams);
+                if(!params.empty())
+                    curve->getPoints(&params[0], &points[0], params.size());
+                return true;
+            }
+            case TESSELLATE:{
+                if(!(request.tolerance > 0))
+                    return false;
+                curve->tessellateTo(request.tolerance, points);
+                return true;
+            }
+            default:
+                return false;
+        }
+    }
+};
+
+
+//counts the clients being served, so the accept loop can wait for a free slot
+class ConnectionSlots
+{
+    std::mutex mutex;
+    std::condition_variable freed;
+    int available;
+
+public:
+    ConnectionSlots(int count):available(count){}
+
+    void acquire(){
+        std::unique_lock<std::mutex> lock(mutex);
+        while(available == 0)
+            freed.wait(lock);
+        available--;
+    }
+
+    void release(){
+        std::lock_guard<std::mutex> lock(mutex);
+        available++;
+        freed.notify_one();
+    }
+};
+
+
+int runService(const char *socketPath){
+    //a client hanging up mid-response must not kill the server
+    signal(SIGPIPE, SIG_IGN);
+    //never deleted: the detached workers wait on it until the process exits
+    Service &service = *new Service;
+
+    if(socketPath == nullptr){
+        service.readLoop(std::make_shared<Connection>(0, 1));
+        service.printStats();
+        return 0;
+    }
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if(listener < 0 || strlen(socketPath) >= sizeof(address.sun_path)){
+        fprintf(stderr, "cannot listen on %s\n", socketPath);
+        return 1;
+    }
+    strcpy(address.sun_path, socketPath);
+    unlink(socketPath);
+    if(bind(listener, (sockaddr*)&address, sizeof(address)) != 0 || listen(listener, 16) != 0){
+        fprintf(stderr, "cannot listen on %s: %s\n", socketPath, strerror(errno));
+        return 1;
+    }
+    fprintf(stderr, "serving on %s\n", socketPath);
+    //never deleted, like service: the detached client threads outlive this loop
+    ConnectionSlots &slots = *new ConnectionSlots(maxConnections);
+    for(;;){
+        slots.acquire();
+        int client = accept(listener, nullptr, nullptr);
+        if(client < 0){
+            slots.release();
+            if(errno == EINTR)
+                continue;
+            break;
+        }
+        std::thread([&service, &slots, client](){
+            service.readLoop(std::make_shared<Connection>(client, client));
+            close(client);
+            service.printStats();
+            slots.release();
+        }).detach();
+    }
+    close(listener);
+    return 1;
+}
+
+
+//--------------------------------------------------------
+// Load generator
+//--------------------------------------------------------
+
+int runLoadGenerator(const char *socketPath, double seconds){
+    const int numCurves = 16;
+    const int paramsPerRequest = 256;
+    //requests kept in flight, so the server's workers all have something to do
+    const int window = 64;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if(fd < 0 || strlen(socketPath) >= sizeof(address.sun_path)){
+        fprintf(stderr, "cannot connect to %s\n", socketPath);
+        return 1;
+    }
+    strcpy(address.sun_path, socketPath);
+    if(connect(fd, (sockaddr*)&address, sizeof(address)) != 0){
+        fprintf(stderr, "cannot connect to %s: %s\n", socketPath, strerror(errno));
+        return 1;
+    }
+
+    //a fixed set of curves reused across requests, as a pipeline would
+    std::vector<std::vector<char> > messages;
+    for(int c=0; c<numCurves; c++){
+        ServiceRequest request;
+        request.id = c;
+        request.curveType = c % CURVE_TYPE_COUNT;
+        request.mode = EVALUATE_PARAMS;
+        request.numControlPoints = 4 + c % 5;
+        request.numParams = paramsPerRequest;
+        request.tolerance = 0;
+        std::vector<float> payload;
+        for(unsigned int i=0; i<request.numControlPoints; i++){
+            float2 p = float2::random();
+            payload.push_back(p.x);
+            payload.push_back(p.y);
+        }
+        for(int i=0; i<paramsPerRequest; i++)
+            payload.push_back(float(i) / (paramsPerRequest - 1));
+        const char *header = (const char*)&request;
+        const char *body = (const char*)&payload[0];
+        std::vector<char> message(header, header + sizeof(request));
+        message.insert(message.end(), body, body + payload.size() * sizeof(float));
+        messages.push_back(message);
+    }
+
+    uint64_t requests = 0;
+    uint64_t samples = 0;
+    std::vector<float> coords;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    double elapsed = 0;
+    while(elapsed < seconds){
+        for(int i=0; i<window; i++){
+            const std::vector<char>& message = messages[(requests + i) % numCurves];
+            if(!writeFully(fd, &message[0], message.size())){
+                fprintf(stderr, "server hung up\n");
+                return 1;
+            }
+        }
+        for(int i=0; i<window; i++){
+            ServiceResponse response;
+            if(!readFully(fd, &response, sizeof(response))){
+                fprintf(stderr, "server hung up\n");
+                return 1;
+            }
+            coords.resize(response.numPoints * 2);
+            if(response.numPoints > 0 && !readFully(fd, &coords[0], coords.size() * sizeof(float))){
+                fprintf(stderr, "server hung up\n");
+                return 1;
+            }
+            if(response.status != SERVICE_OK){
+                fprintf(stderr, "request %u failed\n", response.id);
+                return 1;
+            }
+            samples += response.numPoints;
+        }
+        requests += window;
+        elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    close(fd);
+    printf("loadgen: %llu requests, %llu samples in %.2f s: %.0f samples/s\n",
+           (unsigned long long)requests, (unsigned long long)samples, elapsed, samples / elapsed);
+    return 0;
+}
@@ -0,0 +1,63 @@
+//
+//  service.h
+//  CurvesEditor
+//
+//  Headless curve evaluation: CurvesEditor --serve [socket path] answers
+//  batched requests on stdin/stdout, or on a Unix socket when a path is
+//  given. CurvesEditor --loadgen <socket path> [seconds] drives a running
+//  server and reports samples per second.
+//
+//  Every message is a fixed header followed by float32 payload, in host
+//  byte order (the service is local only).
+//
+//  request:  ServiceRequest, then numControlPoints (x, y) pairs, then
+//            numParams parameters when mode is EVALUATE_PARAMS
+//  response: ServiceResponse, then numPoints (x, y) pairs
+//
+//  Requests are handed to a worker pool as soon as they are read, so
+//  responses may come back out of order; match them up by id.
+//
+
+#ifndef __CurvesEditor__service__
+#define __CurvesEditor__service__
+
+#include <stdint.h>
+
+enum ServiceMode {
+    //evaluate the curve at each of the given parameters
+    EVALUATE_PARAMS = 0,
+    //a strip within tolerance of the curve
+    TESSELLATE = 1
+};
+
+enum ServiceStatus {
+    SERVICE_OK = 0,
+    SERVICE_BAD_REQUEST = 1
+};
+
+struct ServiceRequest {
+    uint32_t id;
+    //a CurveType
+    uint32_t curveType;
+    //a ServiceMode
+    uint32_t mode;
+    uint32_t numControlPoints;
+    uint32_t numParams;
+    float tolerance;
+};
+
+struct ServiceResponse {
+    uint32_t id;
+    uint32_t status;
+    uint32_t numPoints;
+};
+
+//upper bounds on a single request, so a corrupt header cannot make us allocate wildly
+const uint32_t maxServiceControlPoints = 1 << 16;
+const uint32_t maxServiceParams = 1 << 20;
+
+//both return the process exit code
+int runService(const char *socketPath);
+int runLoadGenerator(const char *socketPath, double seconds);
+
+#endif /* defined(__CurvesEditor__service__) */
@@ -0,0 +1,131 @@
+//
+//  slotmap.h
+//  CurvesEditor
+//
+//  Generational slot map: stable handles into densely packed storage.
+//  Insert, lookup and erase are all O(1); erase swap-removes from the
+//  dense array and bumps the slot generation so stale handles stop
+//  resolving instead of aliasing whatever reuses the slot.
+//
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+class SlotHandle
+{
+public:
+    uint32_t index;
+    uint32_t generation;
+
+    //generation 0 is never handed out, so a default handle is always invalid
+    SlotHandle():index(0),generation(0){}
+
+    SlotHandle(uint32_t index, uint32_t generation):index(index),generation(generation){}
+
+    bool operator==(const SlotHandle& other) const
+    {
+        return index == other.index && generation == other.generation;
+    }
+
+    bool operator!=(const SlotHandle& other) const
+    {
+        return !(*this == other);
+    }
+};
+
+
+template <class T>
+class SlotMap
+{
+    struct Slot
+    {
+        uint32_t denseIndex;
+        uint32_t generation;
+    };
+
+    std::vector<T> dense;
+    //which slot owns each dense element, needed to patch the slot on swap-remove
+    std::vector<uint32_t> denseToSlot;
+    std::vector<Slot> slots;
+    std::vector<uint32_t> freeSlots;
+
+public:
+    SlotHandle insert(const T& value)
+    {
+        uint32_t slotIndex;
+        if(!freeSlots.empty()){
+            slotIndex = freeSlots.back();
+            freeSlots.pop_back();
+        }
+        else{
+            slotIndex = (uint32_t)slots.size();
+            Slot slot;
+            slot.generation = 1;
+            slots.push_back(slot);
+        }
+        slots[slotIndex].denseIndex = (uint32_t)dense.size();
+        dense.push_back(value);
+        denseToSlot.push_back(slotIndex);
+        return SlotHandle(slotIndex, slots[slotIndex].generation);
+    }
+
+    bool contains(SlotHandle h) const
+    {
+        return h.index < slots.size() && slots[h.index].generation == h.generation;
+    }
+
+    //returns nullptr for stale or default handles
+    T* get(SlotHandle h)
+    {
+        if(!contains(h))
+            return nullptr;
+        return &dense[slots[h.index].denseIndex];
+    }
+
+    //position of the element in dense order, -1 if the handle is stale
+    int indexOf(SlotHandle h) const
+    {
+        if(!contains(h))
+            return -1;
+        return slots[h.index].denseIndex;
+    }
+
+    bool erase(SlotHandle h)
+    {
+        if(!contains(h))
+            return false;
+        uint32_t hole = slots[h.index].denseIndex;
+        uint32_t last = (uint32_t)dense.size() - 1;
+        if(hole != last){
+            dense[hole] = dense[last];
+            denseToSlot[hole] = denseToSlot[last];
+            slots[denseToSlot[hole]].denseIndex = hole;
+        }
+        dense.pop_back();
+        denseToSlot.pop_back();
+
+        slots[h.index].generation++;
+        if(slots[h.index].generation == 0)
+            slots[h.index].generation = 1;
+        freeSlots.push_back(h.index);
+        return true;
+    }
+
+    int size() const
+    {
+        return (int)dense.size();
+    }
+
+    T& at(int i)
+    {
+        return dense[i];
+    }
+
+    SlotHandle handleAt(int i) const
+    {
+        uint32_t slotIndex = denseToSlot[i];
+        return SlotHandle(slotIndex, slots[slotIndex].generation);
+    }
+};
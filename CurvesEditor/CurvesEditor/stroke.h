@@ -0,0 +1,148 @@
+//
+//  stroke.h
+//  CurvesEditor
+//
+//  Builds the triangles for a line strip drawn at a given width, so thick
+//  curves look the same everywhere instead of depending on glLineWidth.
+//  The output is a plain triangle list, so the meshes of many curves can
+//  be appended together and drawn with a single glDrawArrays.
+//
+
+#pragma once
+
+#include <vector>
+#include <cmath>
+#include "float2.h"
+
+enum StrokeJoin {
+    MITER_JOIN,
+    ROUND_JOIN
+};
+
+template <class S>
+class StrokeBuilder
+{
+    typedef vec2<S> point;
+
+    std::vector<point>& triangles;
+    S halfWidth;
+
+    static S cross(point a, point b)
+    {
+        return a.x * b.y - a.y * b.x;
+    }
+
+    //left-hand normal of a segment, scaled to half the width
+    point normal(point from, point to) const
+    {
+        point d = (to - from).normalized();
+        return point(-d.y, d.x) * halfWidth;
+    }
+
+    void triangle(point a, point b, point c)
+    {
+        triangles.push_back(a);
+        triangles.push_back(b);
+        triangles.push_back(c);
+    }
+
+    //fan around center, starting at offset from and turning counterclockwise by angle
+    void arc(point center, point from, S angle)
+    {
+        //roughly one triangle per 0.3 radians keeps the edge smooth at these widths
+        int steps = int(std::fabs(angle) / S(0.3)) + 1;
+        S step = angle / steps;
+        S cs = std::cos(step);
+        S sn = std::sin(step);
+        point previous = from;
+        for(int i=0; i<steps; i++){
+            point next(previous.x * cs - previous.y * sn, previous.x * sn + previous.y * cs);
+            triangle(center, center + previous, center + next);
+            previous = next;
+        }
+    }
+
+    void join(point at, point na, point nb, StrokeJoin style)
+    {
+        S turn = cross(na, nb);
+        if(turn == 0){
+            if(na.x * nb.x + na.y * nb.y > 0)
+                return;
+            //the strip doubles back: the gap is the half disc ahead of the turning point
+            if(style == ROUND_JOIN){
+                arc(at, -na, S(3.14159265358979323846));
+                return;
+            }
+            //the miter would be infinitely long; bevel at half the width ahead
+            point ahead(na.y, -na.x);
+            triangle(at + na, at - na, at + ahead);
+            return;
+        }
+        //the gap opens on the outside of the turn
+        point a = turn > 0 ? -na : na;
+        point b = turn > 0 ? -nb : nb;
+        if(style == ROUND_JOIN){
+            //the short way round from a to b
+            arc(at, a, std::atan2(cross(a, b), a.x * b.x + a.y * b.y));
+            return;
+        }
+        point bisector = a + b;
+        S length2 = bisector.norm2();
+        //the miter reaches halfWidth / cos(half the turn); past 4x that, bevel
+        S cosHalf = length2 > 0 ? std::sqrt(length2) / (2 * halfWidth) : S(0);
+        if(cosHalf < S(0.25)){
+            triangle(at, at + a, at + b);
+            return;
+        }
+        point miter = bisector.normalized() * (halfWidth / cosHalf);
+        triangle(at, at + a, at + miter);
+        triangle(at, at + miter, at + b);
+    }
+
+public:
+    StrokeBuilder(std::vector<point>& triangles, S width):triangles(triangles),halfWidth(width / 2){}
+
+    void build(const point* strip, int n, StrokeJoin style, bool roundCaps)
+    {
+        if(n < 2)
+            return;
+        //repeated points have no direction and are stepped over
+        point p0 = strip[0];
+        point firstNormal;
+        point previousNormal;
+        int segments = 0;
+        for(int i=1; i<n; i++){
+            point p1 = strip[i];
+            if((p1 - p0).norm2() == 0)
+                continue;
+            point nrm = normal(p0, p1);
+            triangle(p0 + nrm, p0 - nrm, p1 + nrm);
+            triangle(p1 + nrm, p0 - nrm, p1 - nrm);
+            if(segments > 0)
+                join(p0, previousNormal, nrm, style);
+            else
+                firstNormal = nrm;
+            previousNormal = nrm;
+            p0 = p1;
+            segments++;
+        }
+        if(segments == 0)
+            return;
+
+        //half turns from one side to the other, bulging away from the stroke
+        if(roundCaps){
+            const S pi = S(3.14159265358979323846);
+            arc(strip[0], firstNormal, pi);
+            arc(p0, -previousNormal, pi);
+        }
+    }
+};
+
+//appends the triangles of strip stroked at width
+template <class S>
+void buildStroke(const vec2<S>* strip, int n, S width, StrokeJoin style, bool roundCaps,
+                 std::vector<vec2<S> >& triangles)
+{
+    StrokeBuilder<S> builder(triangles, width);
+    builder.build(strip, n, style, roundCaps);
+}